@@ -0,0 +1,382 @@
+// gdiv_bench: throughput of the metric engines over a matrix of workload shapes.
+//
+// For every pattern x raster size x data type x nodata fraction x tile size x
+// compression a set of neutral-landscape GeoTIFFs (tools/landscape.h, fixed seeds) is written
+// once, then each metric is timed at every thread count. One JSON document goes
+// to stdout (or --out).
+//
+//   gdiv_bench [--patterns random,clustered,fractal] [--sizes 1024,4096]
+//              [--types byte,int16,float32] [--nodata 0,0.25] [--tiles 256,512]
+//              [--compress none,DEFLATE,LZW] [--threads 1,0] [--metrics msr,shdi,lsi,shdi_many] [--files 4]
+//              [--classes 8] [--patch 32] [--repeat 3] [--dir <tmp>] [--out <file>] [--keep]
+//
+// threads 0 = one per hardware thread. Times are the best of --repeat runs, each
+// opening the files afresh. compress is the GeoTIFF COMPRESS option, none = raw.
+// io_seconds is a decode-only pass over the same files, tile and threads through
+// the metric's own read path (for_each_block_double for the C API metrics,
+// process_many for shdi_many); compute_seconds is the rest of the metric's time.
+// The C API metrics read tile by tile (no whole-raster reads), so --tiles applies
+// to every row.
+#include "gdiv_toolbox.h"
+#include "gdiv/runner/runner.h"
+#include "gdiv_utils.h"
+#include "landscape.h"
+#include <gdal_priv.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+  #include <windows.h>
+  #include <psapi.h>
+#else
+  #include <sys/resource.h>
+#endif
+
+namespace fs = std::filesystem;
+using gdiv::runner::RunOptions;
+
+namespace {
+
+struct Config {
+    std::vector<std::string> patterns{"random", "clustered", "fractal"};
+    std::vector<int> sizes{1024, 4096};
+    std::vector<std::string> types{"byte", "int16", "float32"};
+    std::vector<double> nodata{0.0, 0.25};
+    std::vector<int> tiles{256, 512};
+    std::vector<std::string> compress{"none", "DEFLATE", "LZW"};
+    std::vector<int> threads{1, 0};
+    std::vector<std::string> metrics{"msr", "shdi", "lsi", "shdi_many"};
+    int files = 4;
+    int classes = 8;
+    int patch = 32;
+    int repeat = 3;
+    std::string dir;
+    std::string out;
+    bool keep = false;
+};
+
+std::vector<std::string> split(const std::string& s) {
+    std::vector<std::string> v;
+    std::stringstream ss(s);
+    for (std::string item; std::getline(ss, item, ',');)
+        if (!item.empty()) v.push_back(item);
+    return v;
+}
+
+template <class T, class F>
+std::vector<T> split_as(const std::string& s, F conv) {
+    std::vector<T> v;
+    for (const auto& item : split(s)) v.push_back(conv(item));
+    return v;
+}
+
+bool parse_args(int argc, char** argv, Config& cfg) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+        auto value = [&]() -> std::string { return (i + 1 < argc) ? argv[++i] : std::string(); };
+        auto to_int = [](const std::string& s) { return std::atoi(s.c_str()); };
+        auto to_dbl = [](const std::string& s) { return std::atof(s.c_str()); };
+        if (a == "--patterns") cfg.patterns = split(value());
+        else if (a == "--sizes") cfg.sizes = split_as<int>(value(), to_int);
+        else if (a == "--types") cfg.types = split(value());
+        else if (a == "--nodata") cfg.nodata = split_as<double>(value(), to_dbl);
+        else if (a == "--tiles") cfg.tiles = split_as<int>(value(), to_int);
+        else if (a == "--compress") cfg.compress = split(value());
+        else if (a == "--threads") cfg.threads = split_as<int>(value(), to_int);
+        else if (a == "--metrics") cfg.metrics = split(value());
+        else if (a == "--files") cfg.files = std::max(1, to_int(value()));
+        else if (a == "--classes") cfg.classes = std::max(1, to_int(value()));
+        else if (a == "--patch") cfg.patch = std::max(1, to_int(value()));
+        else if (a == "--repeat") cfg.repeat = std::max(1, to_int(value()));
+        else if (a == "--dir") cfg.dir = value();
+        else if (a == "--out") cfg.out = value();
+        else if (a == "--keep") cfg.keep = true;
+        else {
+            std::fprintf(stderr, "unknown argument: %s\n", a.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+GDALDataType data_type(const std::string& name) {
+    if (name == "byte") return GDT_Byte;
+    if (name == "int16") return GDT_Int16;
+    if (name == "uint16") return GDT_UInt16;
+    if (name == "int32") return GDT_Int32;
+    if (name == "float32") return GDT_Float32;
+    if (name == "float64") return GDT_Float64;
+    return GDT_Unknown;
+}
+
+// Peak resident set since the last reset_peak_rss() (Linux), else since start
+void reset_peak_rss() {
+#if defined(__linux__)
+    if (std::FILE* f = std::fopen("/proc/self/clear_refs", "w")) {
+        std::fputs("5", f);
+        std::fclose(f);
+    }
+#endif
+}
+
+uint64_t peak_rss_bytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return pmc.PeakWorkingSetSize;
+    return 0;
+#else
+  #if defined(__linux__)
+    if (std::FILE* f = std::fopen("/proc/self/status", "r")) {
+        char line[256];
+        unsigned long long kb = 0;
+        while (std::fgets(line, sizeof(line), f))
+            if (std::sscanf(line, "VmHWM: %llu kB", &kb) == 1) break;
+        std::fclose(f);
+        if (kb) return kb * 1024;
+    }
+  #endif
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+  #if defined(__APPLE__)
+    return static_cast<uint64_t>(ru.ru_maxrss);
+  #else
+    return static_cast<uint64_t>(ru.ru_maxrss) * 1024;
+  #endif
+#endif
+}
+
+double now_seconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Decodes and drops: the I/O share of a process_many run
+struct NullReducer {
+    static constexpr int metrics = 1;
+    uint64_t n = 0;
+    void init(const gdiv::runner::DatasetInfo&) { n = 0; }
+    void accumulate(const gdiv::runner::Block& blk) { n += blk.pixels(); }
+    void merge(NullReducer&& o) { n += o.n; }
+    void finalize(double* out) { out[0] = static_cast<double>(n); }
+};
+
+struct Timing {
+    double seconds = 0;
+    uint64_t peak_rss = 0;
+    int status = 0;                            // first non-zero code of the run
+    gdiv::runner::PipelineStats pipeline;      // shdi_many only
+};
+
+// Best of `repeat` runs of fn(timing), which fills in status and stats. Every
+// run opens the files again: no run reuses the datasets or maps of the last one.
+template <class F>
+Timing best_of(int repeat, F fn) {
+    Timing best;
+    best.seconds = -1;
+    for (int r = 0; r < repeat; ++r) {
+        Timing t;
+        gdiv_close_datasets();
+        reset_peak_rss();
+        const double t0 = now_seconds();
+        fn(t);
+        t.seconds = now_seconds() - t0;
+        t.peak_rss = peak_rss_bytes();
+        if (best.seconds < 0 || t.seconds < best.seconds) best = t;
+    }
+    return best;
+}
+
+int spec_metric(const std::string& name) {
+    if (name == "msr") return GDIV_METRIC_MSR;
+    if (name == "shdi") return GDIV_METRIC_SHDI;
+    if (name == "lsi") return GDIV_METRIC_LSI;
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Config cfg;
+    if (!parse_args(argc, argv, cfg)) return 100;
+    for (const auto& t : cfg.types) {
+        if (data_type(t) == GDT_Unknown) {
+            std::fprintf(stderr, "unknown type: %s\n", t.c_str());
+            return 100;
+        }
+    }
+    std::vector<gdiv::landscape::Pattern> patterns;
+    for (const auto& p : cfg.patterns) {
+        patterns.emplace_back();
+        if (!gdiv::landscape::parse_pattern(p, patterns.back())) {
+            std::fprintf(stderr, "unknown pattern: %s\n", p.c_str());
+            return 100;
+        }
+    }
+
+    GDALAllRegister();
+    std::error_code ec;
+    const fs::path dir = cfg.dir.empty() ? fs::temp_directory_path(ec) / "gdiv_bench" : fs::path(cfg.dir);
+    fs::create_directories(dir, ec);
+    if (!fs::is_directory(dir, ec)) {
+        std::fprintf(stderr, "cannot create %s\n", dir.string().c_str());
+        return 4;
+    }
+
+    std::FILE* out = cfg.out.empty() ? stdout : std::fopen(cfg.out.c_str(), "w");
+    if (!out) {
+        std::fprintf(stderr, "cannot write %s\n", cfg.out.c_str());
+        return 4;
+    }
+
+    std::vector<double> classes(cfg.classes);
+    for (int c = 0; c < cfg.classes; ++c) classes[c] = c + 1;
+    const unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+
+    std::fprintf(out, "{\n  \"hardware_threads\": %u,\n  \"repeat\": %d,\n  \"files\": %d,\n  \"classes\": %d,\n  \"cases\": [",
+                 hw, cfg.repeat, cfg.files, cfg.classes);
+    bool first_case = true;
+    int rc = 0;
+
+    for (auto pattern : patterns) for (int size : cfg.sizes) for (const auto& type : cfg.types)
+    for (double nd : cfg.nodata) for (int tile : cfg.tiles) for (const auto& comp : cfg.compress) {
+        // one file set per shape
+        const char* pname = gdiv::landscape::pattern_name(pattern);
+        std::vector<std::string> paths;
+        for (int f = 0; f < cfg.files; ++f) {
+            char name[160];
+            std::snprintf(name, sizeof(name), "bench_%s_%d_%s_%g_%d_%s_%d.tif", pname, size, type.c_str(), nd, tile,
+                          comp.c_str(), f);
+            const std::string p = (dir / name).string();
+            gdiv::landscape::LandscapeSpec spec;
+            spec.pattern = pattern;
+            spec.width = spec.height = size;
+            spec.classes = cfg.classes;
+            spec.nodata_fraction = nd;
+            spec.patch = cfg.patch;
+            spec.seed = 1000u + f;
+            gdiv::landscape::GeoTiffOptions gopt;
+            gopt.type = data_type(type);
+            gopt.tile = tile;
+            gopt.compress = comp == "none" ? std::string() : comp;
+            bool written = false;
+            try {
+                written = gdiv::landscape::write_geotiff(p, spec, gopt);
+            } catch (const std::exception& e) {
+                std::fprintf(stderr, "%s\n", e.what());
+            }
+            if (!written) {
+                std::fprintf(stderr, "cannot write %s\n", p.c_str());
+                rc = 4;
+                continue;
+            }
+            paths.push_back(p);
+        }
+        if (paths.empty()) continue;
+        std::vector<const char*> cpaths;
+        for (const auto& p : paths) cpaths.push_back(p.c_str());
+        const double mpx = static_cast<double>(size) * size * paths.size() / 1e6;
+
+        for (int threads : cfg.threads) {
+            RunOptions ro;
+            ro.tile = tile;
+            ro.threads = threads;
+            ro.cache = false;
+            // max_bytes_simple = 1: never a whole-raster read, the file's tiles are the windows
+            RasterOptions opt{8, 0.0, 0, threads, 1, tile, 1};
+            const Timing io_many = best_of(cfg.repeat, [&](Timing& r) {
+                try {
+                    gdiv::runner::process_many(paths, ro, NullReducer{});
+                } catch (const std::exception&) {
+                    r.status = 9;
+                }
+            });
+            // the windows gdiv_calculate_batch reads, one file per worker as it does
+            const Timing io_batch = best_of(cfg.repeat, [&](Timing& r) {
+                std::atomic<size_t> next{0};
+                std::atomic<int> status{0};
+                gdiv::runner::detail::run_workers(gdiv::runner::resolve_threads(threads, paths.size()), [&](int) {
+                    for (size_t i; (i = next.fetch_add(1)) < paths.size();) {
+                        int s;
+                        try {
+                            s = for_each_block_double(paths[i].c_str(), &opt, [](const gdiv::runner::Block&) {});
+                        } catch (const std::exception&) {
+                            s = 9;
+                        }
+                        int none = 0;
+                        if (s) status.compare_exchange_strong(none, s);
+                    }
+                });
+                r.status = status;
+            });
+
+            for (const auto& metric : cfg.metrics) {
+                Timing t;
+                const Timing& io = metric == "shdi_many" ? io_many : io_batch;
+                if (metric == "shdi_many") {
+                    t = best_of(cfg.repeat, [&](Timing& r) {
+                        try {
+                            r.pipeline = gdiv::runner::process_many_shdi(paths, ro).stats;
+                        } catch (const std::exception&) {
+                            r.status = 9;
+                        }
+                    });
+                } else if (const int m = spec_metric(metric)) {
+                    MetricSpec spec{m, m == GDIV_METRIC_SHDI ? classes.data() : nullptr,
+                                    m == GDIV_METRIC_SHDI ? cfg.classes : 0};
+                    const int cols = gdiv_batch_columns(&spec, 1);
+                    std::vector<double> res(paths.size() * cols);
+                    std::vector<int> st(paths.size());
+                    t = best_of(cfg.repeat, [&](Timing& r) {
+                        r.status = gdiv_calculate_batch(cpaths.data(), (int)cpaths.size(), &spec, 1, &opt,
+                                                        res.data(), st.data());
+                        for (int s : st) if (!r.status && s) r.status = s;
+                    });
+                } else {
+                    std::fprintf(stderr, "unknown metric: %s\n", metric.c_str());
+                    rc = 100;
+                    continue;
+                }
+
+                std::fprintf(out, "%s\n    {\"metric\": \"%s\", \"pattern\": \"%s\", \"size\": %d, \"type\": \"%s\", \"nodata_fraction\": %g, "
+                                  "\"tile\": %d, \"compress\": \"%s\", \"threads\": %d, \"megapixels\": %.3f, \"seconds\": %.6f, "
+                                  "\"mpx_per_s\": %.3f, \"io_seconds\": %.6f, \"compute_seconds\": %.6f, "
+                                  "\"peak_rss_bytes\": %llu, \"status\": %d",
+                             first_case ? "" : ",", metric.c_str(), pname, size, type.c_str(), nd, tile, comp.c_str(),
+                             threads ? threads : (int)hw, mpx, t.seconds,
+                             t.seconds > 0 ? mpx / t.seconds : 0.0,
+                             std::min(io.seconds, t.seconds), std::max(0.0, t.seconds - io.seconds),
+                             (unsigned long long)t.peak_rss, t.status);
+                if (metric == "shdi_many") {
+                    const auto& p = t.pipeline;
+                    std::fprintf(out, ", \"pipeline\": {\"io_threads\": %d, \"io_busy_seconds\": %.6f, "
+                                      "\"io_utilization\": %.3f, \"compute_threads\": %d, "
+                                      "\"compute_busy_seconds\": %.6f, \"compute_utilization\": %.3f}",
+                                 p.io.threads, p.io.busy_seconds, p.io.utilization(p.wall_seconds),
+                                 p.compute.threads, p.compute.busy_seconds, p.compute.utilization(p.wall_seconds));
+                }
+                std::fprintf(out, "}");
+                std::fflush(out);
+                first_case = false;
+                if (t.status && !rc) rc = t.status;
+            }
+        }
+
+        gdiv_close_datasets();
+        if (!cfg.keep)
+            for (const auto& p : paths) fs::remove(p, ec);
+    }
+
+    std::fprintf(out, "\n  ]\n}\n");
+    if (out != stdout) std::fclose(out);
+    return rc;
+}
@@ -6,6 +6,8 @@ from pathlib import Path
 import ctypes as C
 import pandas as pd
 import numpy as np
+import pyarrow as pa
+from pyarrow.cffi import ffi as arrow_ffi
 import sys, os
 
 # === 1) Set directories ===
@@ -37,81 +39,51 @@ if "CONDA_PREFIX" in os.environ:
 gdiv = C.CDLL(str(DLL_PATH))
 
 # === 3) Bind to C interfaces ===
-# int gdiv_calculate_msr(const char* path, const RasterOptions* opt,
-#                        double* mean, double* stdv, double* vmin, double* vmax, uint64_t* valid);
-gdiv.gdiv_calculate_msr.argtypes = [
-    C.c_char_p, C.c_void_p,
-    C.POINTER(C.c_double), C.POINTER(C.c_double),
-    C.POINTER(C.c_double), C.POINTER(C.c_double),
-    C.POINTER(C.c_uint64)
-]
-gdiv.gdiv_calculate_msr.restype = C.c_int
-
-# int gdiv_calculate_shdi(const char* path,
-#                         const double* classes, int n_classes,
-#                         const RasterOptions* opt,
-#                         double* out_shdi, double* probs, uint64_t* out_valid);
-gdiv.gdiv_calculate_shdi.argtypes = [
-    C.c_char_p,
-    C.POINTER(C.c_double), C.c_int,
+GDIV_METRIC_MSR, GDIV_METRIC_SHDI, GDIV_METRIC_LSI = 1, 2, 3
+
+class MetricSpec(C.Structure):
+    _fields_ = [("metric", C.c_int),
+                ("classes", C.POINTER(C.c_double)),
+                ("n_classes", C.c_int)]
+
+# int gdiv_calculate_batch_arrow(const char* const* paths, int n_paths,
+#                                const MetricSpec* specs, int n_specs,
+#                                const RasterOptions* opt,
+#                                const char* const* ids, const char* prefix,
+#                                struct ArrowSchema* out_schema,
+#                                struct ArrowArray* out_array, int* status);
+gdiv.gdiv_calculate_batch_arrow.argtypes = [
+    C.POINTER(C.c_char_p), C.c_int,
+    C.POINTER(MetricSpec), C.c_int,
     C.c_void_p,
-    C.POINTER(C.c_double), C.POINTER(C.c_double),
-    C.POINTER(C.c_uint64)
-]
-gdiv.gdiv_calculate_shdi.restype = C.c_int
-
-# int gdiv_calculate_lsi(const char* path, const RasterOptions* opt,
-#                        double* out_lsi, uint64_t* out_valid);
-gdiv.gdiv_calculate_lsi.argtypes = [
-    C.c_char_p, C.c_void_p,
-    C.POINTER(C.c_double), C.POINTER(C.c_uint64)
+    C.POINTER(C.c_char_p), C.c_char_p,
+    C.c_void_p, C.c_void_p,
+    C.POINTER(C.c_int)
 ]
-gdiv.gdiv_calculate_lsi.restype = C.c_int
-
-# === 4) Small helper wrappers ===
-def compute_msr_mean_and_msr(path: Path):
-    """Return (msr, mean), where msr = std (standard deviation)."""
-    p = str(path).encode("utf-8")
-    mean = C.c_double(); stdv = C.c_double()
-    vmin = C.c_double(); vmax = C.c_double()
-    valid = C.c_uint64()
-    ret = gdiv.gdiv_calculate_msr(
-        p, None, C.byref(mean), C.byref(stdv),
-        C.byref(vmin), C.byref(vmax), C.byref(valid)
-    )
-    if ret != 0:
-        raise RuntimeError(f"gdiv_calculate_msr failed: code={ret}, path={path}")
-    return stdv.value, mean.value  # (msr=std, mean)
-
-def compute_shdi_and_probs(path: Path, classes):
-    """Return (H, probs_array); probs_array has length = len(classes)."""
-    if not classes:
-        raise ValueError("SHDI classes is empty.")
-    p = str(path).encode("utf-8")
-    cls = np.asarray(classes, dtype=np.float64)
-    H = C.c_double()
-    probs_buf = (C.c_double * len(cls))()
-    valid = C.c_uint64()
-    ret = gdiv.gdiv_calculate_shdi(
-        p,
-        cls.ctypes.data_as(C.POINTER(C.c_double)), len(cls),
-        None,
-        C.byref(H), probs_buf, C.byref(valid)
+gdiv.gdiv_calculate_batch_arrow.restype = C.c_int
+
+# === 4) Batch helper ===
+def compute_batch(paths, ids, specs, prefix):
+    """Run every spec on every path in one call (parallel inside the DLL).
+    Returns (pyarrow.RecordBatch taken over zero-copy, status[n_paths, n_specs])."""
+    spec_arr = (MetricSpec * len(specs))(*specs)
+    path_arr = (C.c_char_p * len(paths))(*[str(p).encode("utf-8") for p in paths])
+    id_arr = (C.c_char_p * len(ids))(*[str(i).encode("utf-8") for i in ids])
+    status = np.empty((len(paths), len(specs)), dtype=np.int32)
+
+    c_schema = arrow_ffi.new("struct ArrowSchema*")
+    c_array = arrow_ffi.new("struct ArrowArray*")
+    p_schema = int(arrow_ffi.cast("uintptr_t", c_schema))
+    p_array = int(arrow_ffi.cast("uintptr_t", c_array))
+    ret = gdiv.gdiv_calculate_batch_arrow(
+        path_arr, len(paths), spec_arr, len(specs), None,
+        id_arr, prefix.encode("utf-8"),
+        C.c_void_p(p_schema), C.c_void_p(p_array),
+        status.ctypes.data_as(C.POINTER(C.c_int))
     )
     if ret != 0:
-        raise RuntimeError(f"gdiv_calculate_shdi failed: code={ret}, path={path}")
-    probs = [probs_buf[i] for i in range(len(cls))]
-    return H.value, probs
-
-def compute_lsi(path: Path):
-    """Return the LSI value."""
-    p = str(path).encode("utf-8")
-    out = C.c_double()
-    valid = C.c_uint64()
-    ret = gdiv.gdiv_calculate_lsi(p, None, C.byref(out), C.byref(valid))
-    if ret != 0:
-        raise RuntimeError(f"gdiv_calculate_lsi failed: code={ret}, path={path}")
-    return out.value
+        raise RuntimeError(f"gdiv_calculate_batch_arrow failed: code={ret}")
+    return pa.RecordBatch._import_from_c(p_array, p_schema), status
 
 # === 5) Scan data folders ===
 # factor = subfolder name
@@ -130,66 +102,37 @@ for sub in sorted(p for p in DATA_ROOT.iterdir() if p.is_dir()):
 all_sites = sorted(set().union(*(m.keys() for m in factor_to_files.values())))
 
 # === 6) Calculate metrics and merge results ===
-rows = []
-for site in all_sites:
-    row = {"siteID": site}
-    for factor in factors:
-        tif = factor_to_files[factor].get(site)
-
-        # Predeclare columns for this factor
-        col_msr  = f"{factor}_msr"   # MSR = std
-        col_mean = f"{factor}_mean"
-        row[col_msr] = None
-        row[col_mean] = None
-
-        shdi_cols = []
-        if factor in SHDI_FACTORS:
-            row[f"{factor}_shdi"] = None
-            if WRITE_SHDI_PROBS:
-                for code in SHDI_CLASSES.get(factor, []):
-                    cname = f"{factor}_cls{code}_p"
-                    row[cname] = None
-                    shdi_cols.append(cname)
-
-        if factor in LSI_FACTORS:
-            row[f"{factor}_lsi"] = None
-
-        if tif is None:
-            continue
-
-        # --- Compute MSR (std) and mean: always computed for all factors ---
-        try:
-            msr_std, mean_val = compute_msr_mean_and_msr(tif)
-            row[col_msr]  = msr_std
-            row[col_mean] = mean_val
-        except Exception as e:
-            print(f"[WARN] MSR/mean failed: factor={factor}, site={site}, path={tif}\n  -> {e}", file=sys.stderr)
-
-        # --- SHDI ---
-        if factor in SHDI_FACTORS:
-            classes = SHDI_CLASSES.get(factor, [])
-            if classes:
-                try:
-                    H, probs = compute_shdi_and_probs(tif, classes)
-                    row[f"{factor}_shdi"] = H
-                    if WRITE_SHDI_PROBS:
-                        for code, pval in zip(classes, probs):
-                            row[f"{factor}_cls{code}_p"] = pval
-                except Exception as e:
-                    print(f"[WARN] SHDI failed: factor={factor}, site={site}, path={tif}\n  -> {e}", file=sys.stderr)
-            else:
-                print(f"[INFO] SHDI skipped (no classes configured) for factor={factor}", file=sys.stderr)
-
-        # --- LSI ---
-        if factor in LSI_FACTORS:
-            try:
-                row[f"{factor}_lsi"] = compute_lsi(tif)
-            except Exception as e:
-                print(f"[WARN] LSI failed: factor={factor}, site={site}, path={tif}\n  -> {e}", file=sys.stderr)
-
-    rows.append(row)
-
-df = pd.DataFrame(rows).sort_values("siteID")
+# One batch call per factor: MSR always, SHDI/LSI for whitelisted factors.
+# Each factor comes back as an Arrow batch keyed by siteID; failed cells are null.
+df = pd.DataFrame({"siteID": all_sites})
+for factor in factors:
+    sites = [s for s in all_sites if s in factor_to_files[factor]]
+    if not sites:
+        continue
+    paths = [factor_to_files[factor][s] for s in sites]
+
+    specs, names = [MetricSpec(GDIV_METRIC_MSR, None, 0)], ["MSR/mean"]
+    classes = SHDI_CLASSES.get(factor, []) if factor in SHDI_FACTORS else []
+    cls = np.asarray(classes, dtype=np.float64)
+    if factor in SHDI_FACTORS:
+        if classes:
+            specs.append(MetricSpec(GDIV_METRIC_SHDI, cls.ctypes.data_as(C.POINTER(C.c_double)), len(cls)))
+            names.append("SHDI")
+        else:
+            print(f"[INFO] SHDI skipped (no classes configured) for factor={factor}", file=sys.stderr)
+    if factor in LSI_FACTORS:
+        specs.append(MetricSpec(GDIV_METRIC_LSI, None, 0))
+        names.append("LSI")
+
+    batch, status = compute_batch(paths, sites, specs, f"{factor}_")
+    for i, k in zip(*np.nonzero(status)):
+        print(f"[WARN] {names[k]} failed: factor={factor}, site={sites[i]}, path={paths[i]}\n"
+              f"  -> code={status[i, k]}", file=sys.stderr)
+
+    part = batch.to_pandas().rename(columns={"id": "siteID", f"{factor}_var": f"{factor}_msr"})
+    df = df.merge(part, on="siteID", how="left")
+
+df = df.sort_values("siteID")
 
 # Arrange column order: siteID → each factor’s msr/mean → SHDI (+class proportions) → LSI
 ordered = ["siteID"]
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+
+namespace gdiv::runner {
+
+    /** Grow-only scratch storage for tile data.
+     *  Memory is left uninitialized: callers (RasterIO) overwrite it before it is
+     *  read, so no zero-fill pass and no reallocation once the largest tile fits.
+     */
+    template <class T>
+    class ScratchBuffer {
+    public:
+        /** Make room for n elements; returns data(). Existing content is not kept on growth. */
+        T* reserve(size_t n) {
+            if (n > cap_) {
+                data_.reset(new T[n]);   // default-init: no zeroing for arithmetic T
+                cap_ = n;
+            }
+            size_ = n;
+            return data_.get();
+        }
+
+        void release() { data_.reset(); cap_ = size_ = 0; }
+
+        T* data() { return data_.get(); }
+        const T* data() const { return data_.get(); }
+        size_t size() const { return size_; }
+        size_t capacity() const { return cap_; }
+
+    private:
+        std::unique_ptr<T[]> data_;
+        size_t cap_ = 0;
+        size_t size_ = 0;
+    };
+
+    /** Scratch buffers owned by one thread, reused across tiles and rasters. */
+    struct BufferArena {
+        ScratchBuffer<double> tile;
+        ScratchBuffer<int> tile_int;
+    };
+
+    /** Arena of the calling thread. */
+    BufferArena& thread_arena();
+
+} // namespace gdiv::runner
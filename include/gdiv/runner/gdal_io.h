@@ -3,29 +3,100 @@
 #include <vector>
 #include <optional>
 #include <memory>
+#include <list>
+#include <unordered_map>
 #include <gdal_priv.h>
+#include "buffer.h"
 
 namespace gdiv::runner {
 
     struct DatasetInfo {
         int width = 0, height = 0, bands = 0;
         std::optional<double> nodata;
+        int block_w = 0, block_h = 0;   // natural block size of band 1
+        std::string compression;        // IMAGE_STRUCTURE COMPRESSION, empty = none
     };
 
     struct Window {
         int x = 0, y = 0, w = 0, h = 0;
     };
 
+    /** Memory layout of multi-band windows */
+    enum class Layout {
+        BandSequential,    // band planes: [b][y][x]
+        PixelInterleaved   // band values of a pixel together: [y][x][b]
+    };
+
     using GDALDatasetPtr = std::unique_ptr<GDALDataset, void(*)(GDALDataset*)>;
 
     GDALDatasetPtr open_readonly(const std::string& path);
 
+    /** Dataset shared between a pool and its borrowers; closed with the last owner. */
+    using SharedDataset = std::shared_ptr<GDALDataset>;
+
+    class MappedRaster;
+
+    /** Read-only datasets opened by one thread, least recently used evicted.
+     *  GDAL handles must not cross threads, so each thread has its own pool.
+     *  An entry is reopened when the file size or mtime (full clock resolution
+     *  for local files) changed since it was opened; paths that cannot be
+     *  stat'ed are not kept.
+     */
+    class DatasetPool {
+    public:
+        /** nullptr if the dataset cannot be opened */
+        SharedDataset acquire(const std::string& path);
+
+        /** Memory map of a dataset held by this pool, built on first use; nullptr
+         *  when mapped reads are off, ds is not pooled here, or its pixels are not
+         *  stored raw (compressed, sparse, packed bits, foreign byte order).
+         */
+        const MappedRaster* mapped(GDALDataset* ds);
+
+        void clear();
+        size_t size() const;
+
+    private:
+        struct Entry;
+        std::list<Entry> lru_;   // front = most recently used
+        std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    };
+
+    /** Pool of the calling thread. */
+    DatasetPool& thread_dataset_pool();
+
+    /** Open handles kept per thread (default 0 = no pooling). Pooled files stay
+     *  open after a run, which on Windows locks them until the pools are cleared.
+     */
+    void set_dataset_pool_capacity(size_t n);
+    size_t dataset_pool_capacity();
+
+    /** open_readonly() through the calling thread's pool; throws like open_readonly. */
+    SharedDataset open_pooled(const std::string& path);
+
+    /** Read uncompressed GeoTIFF / raw (ENVI, EHdr, ...) files of pooled datasets
+     *  straight from a memory map instead of RasterIO (default off; needs a
+     *  pool capacity > 0). GDAL only locates the pixel data; the file must not
+     *  be rewritten or truncated in place while a pool still maps it.
+     */
+    void set_mapped_reads(bool on);
+    bool mapped_reads();
+
     DatasetInfo describe(GDALDataset* ds);
 
     /** Read a window（all bands or selected band）, output by double, 。
-     *  out.size() will be set:  w*h*bands。
+     *  out must hold w*h*bands values; nothing is zeroed or allocated.
+     *  All bands are read by one GDALDataset::RasterIO call with a band map, so
+     *  pixel-interleaved files decode each block once. Datasets the calling
+     *  thread's pool can map are converted from the mapped file instead.
      */
-    void read_window(GDALDataset* ds, const Window& win, std::vector<double>& out,
-                     int first_band = 1, int band_count = 0 /*0=all*/);
+    void read_window(GDALDataset* ds, const Window& win, double* out,
+                     int first_band = 1, int band_count = 0 /*0=all*/,
+                     Layout layout = Layout::BandSequential);
+
+    /** Same, into a scratch buffer; out.size() will be set: w*h*bands. */
+    void read_window(GDALDataset* ds, const Window& win, ScratchBuffer<double>& out,
+                     int first_band = 1, int band_count = 0 /*0=all*/,
+                     Layout layout = Layout::BandSequential);
 
 } // namespace gdiv::runner
\ No newline at end of file
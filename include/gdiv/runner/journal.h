@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gdiv::runner {
+
+    /** Append-only log of finished rasters, so an interrupted batch can resume.
+     *
+     *  Text file: a header line with the run tag, then one line per raster
+     *      <fnv1a hex>\t<bands>\t<v0> <v1> ...\t<path>
+     *  Each line is flushed as soon as it is written, so a killed process loses
+     *  at most the line being written. Lines that are cut off or fail their
+     *  checksum are dropped when the journal is opened again.
+     */
+    class Journal {
+    public:
+        struct Entry {
+            int bands = 0;
+            std::vector<double> values;   // bands * metrics
+        };
+
+        /** Open or create `path` for a run described by `tag`.
+         *  Throws if the file belongs to a different run or cannot be written.
+         */
+        Journal(const std::string& path, const std::string& tag, int metrics);
+        ~Journal();
+
+        Journal(const Journal&) = delete;
+        Journal& operator=(const Journal&) = delete;
+
+        /** Recorded result of a raster, nullptr if it has none. */
+        const Entry* find(const std::string& raster) const;
+
+        /** Record a finished raster (thread-safe). */
+        void append(const std::string& raster, int bands, const double* values);
+
+        /** Rewrite the journal as one record per raster of `rasters`, in that
+         *  order, dropping duplicates and rasters not listed. The file is
+         *  replaced atomically.
+         */
+        void compact(const std::vector<std::string>& rasters);
+
+        size_t size() const { return entries_.size(); }
+
+    private:
+        void load(bool& dirty);
+        void rewrite(const std::vector<const std::string*>& order);
+        std::string format(const std::string& raster, const Entry& e) const;
+
+        std::string path_;
+        std::string tag_;
+        int metrics_;
+        std::unordered_map<std::string, Entry> entries_;
+        std::FILE* fp_ = nullptr;
+        mutable std::mutex m_;
+    };
+
+} // namespace gdiv::runner
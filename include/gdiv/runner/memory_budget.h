@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+namespace gdiv::runner {
+
+    /** One process-wide memory budget, split between the consumers that grow
+     *  with raster size. Off (0) by default: GDAL_CACHEMAX, RunOptions and the
+     *  256 MB full-read threshold apply unchanged.
+     *
+     *  With a budget set:
+     *  - the GDAL block cache is set to its share;
+     *  - process_many shrinks opt.tile, then the automatic thread counts and
+     *    queue depth, until the decoded tiles in flight fit the buffer share;
+     *    the C API reads whole rasters only when they fit a thread's part of it;
+     *  - reducer state that lives for a whole raster (LSI class and label
+     *    tables) is admitted through MemoryReservation, so rasters that do not
+     *    fit together wait for each other instead of all being held at once.
+     */
+    struct MemoryShares {
+        uint64_t gdal_cache = 0;   // GDALSetCacheMax64
+        uint64_t buffers = 0;      // decoded tiles / full reads
+        uint64_t state = 0;        // per-raster reducer and label tables
+    };
+
+    /** Total bytes for the library (0 = no budget, restores the GDAL cache size). */
+    void set_memory_budget(uint64_t bytes);
+    uint64_t memory_budget();
+
+    /** Split of the current budget; all zero when there is none. */
+    MemoryShares memory_shares();
+
+    /** Holds `bytes` of the state share while alive. The constructor blocks
+     *  until they fit next to the other holders; a request larger than the
+     *  whole share waits until it is alone. Free when there is no budget.
+     *  The wait gives up, holding nothing, once *cancel turns true.
+     */
+    class MemoryReservation {
+    public:
+        MemoryReservation() = default;
+        explicit MemoryReservation(uint64_t bytes, const std::atomic<bool>* cancel = nullptr);
+        ~MemoryReservation();
+
+        MemoryReservation(MemoryReservation&& o) noexcept;
+        MemoryReservation& operator=(MemoryReservation&& o) noexcept;
+        MemoryReservation(const MemoryReservation&) = delete;
+        MemoryReservation& operator=(const MemoryReservation&) = delete;
+
+        void release();
+
+    private:
+        uint64_t bytes_ = 0;
+    };
+
+} // namespace gdiv::runner
@@ -0,0 +1,137 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <vector>
+#include "buffer.h"
+#include "gdal_io.h"
+#include "tiler.h"
+
+namespace gdiv::runner {
+
+    struct RunOptions;
+
+    /** Thread counts of the two stages, the number of tile buffers in flight
+     *  and the tile size they are planned for. compute == 0: the readers reduce
+     *  their own tiles.
+     */
+    struct StagePlan {
+        int io = 1;
+        int compute = 1;
+        size_t queue_depth = 4;
+        int tile = 512;
+    };
+
+    /** Resolve opt.io_threads / compute_threads / queue_depth (0 = automatic).
+     *  Automatic thread counts use at most `tasks` threads (chunks that can be
+     *  worked on at once); one thread, from opt.threads == 1 or a single task,
+     *  runs both stages. `decode` is the compression_factor() of the rasters:
+     *  compressed tiles cost more to decode than a reducer spends on them, so
+     *  every thread reads and reduces its own tiles (compute == 0); raw tiles
+     *  are cheap copies, read by a quarter of the threads for the rest.
+     *  Under a memory budget the tiles in flight (queue_depth tiles of `bands`
+     *  doubles) must fit its buffer share: opt.tile is halved down to 64, then
+     *  the automatic depth and thread counts are lowered. A tile is measured as
+     *  TileRange::for_grid cuts it on the largest of `grids` (blocks larger
+     *  than the tile are read whole), tile x tile pixels when none are given.
+     */
+    StagePlan plan_stages(const RunOptions& opt, int bands = 1,
+                          size_t tasks = std::numeric_limits<size_t>::max(),
+                          const std::vector<BlockGrid>& grids = {}, double decode = 1.0);
+
+    /** Time one stage spent working vs. blocked, summed over its threads. */
+    struct StageStats {
+        int threads = 0;
+        double busy_seconds = 0;
+        double wait_seconds = 0;   // io: no free buffer / no task, compute: nothing ready
+
+        /** busy share of threads * wall, 0..1 */
+        double utilization(double wall_seconds) const {
+            return (threads > 0 && wall_seconds > 0) ? busy_seconds / (wall_seconds * threads) : 0.0;
+        }
+    };
+
+    struct PipelineStats {
+        StageStats io;
+        StageStats compute;
+        size_t queue_depth = 0;
+        double wall_seconds = 0;
+    };
+
+    /** One decoded window, band-sequential. */
+    struct TileBuffer {
+        ScratchBuffer<double> data;
+        Window win;
+    };
+
+    /** Fixed set of tile buffers. acquire() blocks while all are in flight,
+     *  which is what holds the readers back when compute falls behind.
+     */
+    class BufferPool {
+    public:
+        explicit BufferPool(size_t depth);
+
+        /** A free buffer, or nullptr once cancelled. */
+        TileBuffer* acquire();
+        void release(TileBuffer* b);
+        void cancel();
+
+    private:
+        std::vector<TileBuffer> bufs_;
+        std::vector<TileBuffer*> free_;
+        std::mutex m_;
+        std::condition_variable cv_;
+        bool cancelled_ = false;
+    };
+
+    /** FIFO handing work items from the readers to the compute threads. */
+    template <class T>
+    class ReadyQueue {
+    public:
+        void push(T* item) {
+            {
+                std::lock_guard<std::mutex> lk(m_);
+                q_.push_back(item);
+            }
+            cv_.notify_one();
+        }
+
+        /** Next item; nullptr once closed and drained, or cancelled. */
+        T* pop() {
+            std::unique_lock<std::mutex> lk(m_);
+            cv_.wait(lk, [&] { return cancelled_ || closed_ || !q_.empty(); });
+            if (cancelled_ || q_.empty()) return nullptr;
+            T* item = q_.front();
+            q_.pop_front();
+            return item;
+        }
+
+        /** No more pushes (all readers finished). */
+        void close() {
+            { std::lock_guard<std::mutex> lk(m_); closed_ = true; }
+            cv_.notify_all();
+        }
+
+        void cancel() {
+            { std::lock_guard<std::mutex> lk(m_); cancelled_ = true; }
+            cv_.notify_all();
+        }
+
+    private:
+        std::deque<T*> q_;
+        std::mutex m_;
+        std::condition_variable cv_;
+        bool closed_ = false;
+        bool cancelled_ = false;
+    };
+
+    using StageClock = std::chrono::steady_clock;
+
+    inline double seconds_since(StageClock::time_point t0) {
+        return std::chrono::duration<double>(StageClock::now() - t0).count();
+    }
+
+} // namespace gdiv::runner
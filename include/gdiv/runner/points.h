@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include "buffer.h"
+#include "gdal_io.h"
+
+namespace gdiv::runner {
+
+    /** Location in the georeferenced units of a raster. */
+    struct GeoPoint {
+        double x = 0, y = 0;
+    };
+
+    /** Pixels whose centers lie within a radius of a center pixel's center,
+     *  as row spans relative to that pixel. Computed once per radius and
+     *  shared by every point.
+     */
+    struct Disk {
+        struct Span {
+            int dy = 0, dx0 = 0, len = 0;
+        };
+        int rx = 0, ry = 0;   // half extents in pixels
+        std::vector<Span> spans;
+
+        int width() const { return 2 * rx + 1; }
+        int height() const { return 2 * ry + 1; }
+        size_t pixels() const;
+    };
+
+    /** Disk of `radius` (CRS units) for the pixel size of a north-up
+     *  geotransform; throws for rotated transforms or radius < 0.
+     */
+    Disk make_disk(const double* geotransform, double radius);
+
+    /** Center pixel of every point plus the order to visit them in: along a
+     *  Hilbert curve over the pixel grid, so consecutive points share blocks.
+     *  Throws on a NaN or infinite coordinate.
+     */
+    struct PointPlan {
+        Disk disk;
+        std::vector<int> px, py;          // may be outside the raster
+        std::vector<uint32_t> order;      // point indices in curve order
+    };
+
+    PointPlan plan_points(GDALDataset* ds, const std::vector<GeoPoint>& points, double radius);
+
+    /** Points per work item of reduce_points(), consecutive along the curve. */
+    inline constexpr size_t POINT_RUN = 256;
+
+    /** Decoded blocks of one dataset (natural block grid of band 1, selected
+     *  bands band-sequential), least recently used evicted past max_bytes.
+     *  Not thread-safe: one cache per worker.
+     */
+    class BlockCache {
+    public:
+        BlockCache(GDALDataset* ds, int first_band, int bands, size_t max_bytes);
+
+        /** Block (bx, by), decoded on a miss; its area goes to `win`.
+         *  The pointer stays valid until the next get().
+         */
+        const double* get(int bx, int by, Window& win);
+
+        int block_w() const { return bw_; }
+        int block_h() const { return bh_; }
+        uint64_t hits() const { return hits_; }
+        uint64_t misses() const { return misses_; }
+        /** Decoded bytes held. */
+        uint64_t bytes() const;
+
+    private:
+        struct Entry {
+            uint64_t key = 0;
+            Window win;
+            ScratchBuffer<double> data;
+        };
+        GDALDataset* ds_;
+        int first_band_, bands_;
+        int width_ = 0, height_ = 0, bw_ = 1, bh_ = 1;
+        size_t max_blocks_ = 1;
+        std::list<Entry> lru_;   // front = most recently used
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+        uint64_t hits_ = 0, misses_ = 0;
+    };
+
+    /** Cache size per reduce_points() worker: its part of the memory budget's
+     *  buffer share, 64 MB without a budget.
+     */
+    size_t point_cache_bytes(int workers);
+
+} // namespace gdiv::runner
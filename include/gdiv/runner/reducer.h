@@ -0,0 +1,286 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "gdal_io.h"
+
+namespace gdiv::runner {
+
+    /** One window handed to a reducer: `bands` planes of win.w*win.h doubles. */
+    struct Block {
+        const double* data = nullptr;
+        Window win;
+        int bands = 1;
+        std::optional<double> nodata;
+
+        size_t pixels() const { return static_cast<size_t>(win.w) * win.h; }
+    };
+
+    /** NODATA - inf/NaN or equal to nodata */
+    inline bool skip_value(double v, const std::optional<double>& nodata) {
+        if (!std::isfinite(v)) return true;
+        return nodata.has_value() && v == *nodata;
+    }
+
+    /** Reducer requirements (checked at compile time by process_many<R>):
+     *
+     *    static constexpr int metrics;         // values written by finalize()
+     *    void init(const DatasetInfo& info);   // reset for a new raster
+     *    void accumulate(const Block& blk);    // fold one window in
+     *    void merge(R&& other);                // fold another partial state in
+     *    void finalize(double* out);           // write `metrics` values
+     *    std::string fingerprint() const;      // optional: settings that change
+     *                                          // the values (journal/cache keys)
+     *    uint64_t state_bytes(const DatasetInfo&) const;   // optional: whole-raster
+     *                                          // state per band (memory budget)
+     *    uint64_t valid_pixels() const;        // optional: valid pixels seen (stats)
+     *
+     *  Reducers are copied from a prototype once per worker and band, so they
+     *  must be copyable and must not share mutable state between copies.
+     *  process_many hands each copy single-band blocks of its own band;
+     *  reduce_pair hands two-band blocks (one plane per raster).
+     */
+
+    // ---------------------------
+    // MSR: mean, variance, min, max
+    // ---------------------------
+    struct MsrReducer {
+        static constexpr int metrics = 4;
+
+        long double sum = 0, sumsq = 0;
+        double mn = std::numeric_limits<double>::infinity();
+        double mx = -std::numeric_limits<double>::infinity();
+        uint64_t n = 0;
+
+        uint64_t valid_pixels() const { return n; }
+        void init(const DatasetInfo&) { *this = MsrReducer{}; }
+
+        void accumulate(const Block& blk) {
+            const size_t np = blk.pixels();
+            for (size_t i = 0; i < np; ++i) {
+                const double v = blk.data[i];
+                if (skip_value(v, blk.nodata)) continue;
+                sum += v;
+                sumsq += (long double)v * v;
+                ++n;
+                if (v < mn) mn = v;
+                if (v > mx) mx = v;
+            }
+        }
+
+        void merge(MsrReducer&& o) {
+            sum += o.sum; sumsq += o.sumsq; n += o.n;
+            if (o.mn < mn) mn = o.mn;
+            if (o.mx > mx) mx = o.mx;
+        }
+
+        void finalize(double* out) {
+            if (n == 0) {
+                out[0] = out[1] = out[2] = out[3] = std::numeric_limits<double>::quiet_NaN();
+                return;
+            }
+            const double mean = (double)(sum / n);
+            // Variance = E[x^2] - (E[x])^2
+            long double variance = (sumsq / n) - ((long double)mean * mean);
+            if (variance < 0) variance = 0;
+            out[0] = mean; out[1] = (double)variance; out[2] = mn; out[3] = mx;
+        }
+    };
+
+    // ---------------------------
+    // SHDI: over all classes found, or over a fixed class list
+    // ---------------------------
+    struct ShdiReducer {
+        static constexpr int metrics = 1;
+
+        ShdiReducer() = default;
+        explicit ShdiReducer(const std::vector<double>& classes) {
+            for (size_t i = 0; i < classes.size(); ++i)
+                lut[std::llround(classes[i])] = static_cast<int>(i);
+            counts.assign(classes.size(), 0);
+        }
+
+        std::unordered_map<long long, uint64_t> hist;  // free classes
+        std::unordered_map<long long, int> lut;         // fixed classes -> counts index
+        std::vector<uint64_t> counts;
+        uint64_t total = 0;   // pixels counted into hist / counts
+        uint64_t valid = 0;   // all valid pixels, counted or not
+
+        std::string fingerprint() const {
+            if (lut.empty()) return "all";
+            std::vector<long long> classes(lut.size());
+            for (const auto& kv : lut) classes[kv.second] = kv.first;
+            std::string fp = "classes=";
+            for (long long c : classes) fp += std::to_string(c) + ",";
+            return fp;
+        }
+
+        uint64_t valid_pixels() const { return valid; }
+        void init(const DatasetInfo&) {
+            hist.clear();
+            std::fill(counts.begin(), counts.end(), 0);
+            total = valid = 0;
+        }
+
+        void accumulate(const Block& blk) {
+            const size_t np = blk.pixels();
+            for (size_t i = 0; i < np; ++i) {
+                const double v = blk.data[i];
+                if (skip_value(v, blk.nodata)) continue;
+                ++valid;
+
+                // make double int
+                const long long key = std::llround(v);
+                if (lut.empty()) { ++hist[key]; ++total; continue; }
+                auto it = lut.find(key);
+                if (it != lut.end()) { ++counts[it->second]; ++total; }
+            }
+        }
+
+        void merge(ShdiReducer&& o) {
+            for (const auto& kv : o.hist) hist[kv.first] += kv.second;
+            for (size_t i = 0; i < counts.size(); ++i) counts[i] += o.counts[i];
+            total += o.total; valid += o.valid;
+        }
+
+        void finalize(double* out) {
+            long double H = 0.0L;
+            if (total > 0 && lut.empty()) {
+                for (const auto& kv : hist) {
+                    const long double p = static_cast<long double>(kv.second) / total;
+                    if (p > 0) H -= p * std::log(p);
+                }
+            } else if (total > 0) {
+                for (uint64_t c : counts) {
+                    const double p = (double)c / (double)total;
+                    if (p > 0) H -= p * std::log(p);
+                }
+            }
+            out[0] = static_cast<double>(H);
+        }
+    };
+
+    // ---------------------------
+    // LSI: windows are kept until finalize(), components need the whole raster
+    // ---------------------------
+    struct LsiReducer {
+        static constexpr int metrics = 1;
+
+        explicit LsiReducer(int connectivity = 8) : connectivity(connectivity) {}
+
+        struct Piece {
+            Window win;
+            std::vector<int> vals;   // class per pixel, INT_MIN = invalid
+        };
+
+        int connectivity;
+        int width = 0, height = 0;
+        std::vector<Piece> pieces;
+        uint64_t valid = 0;
+        uint64_t patches = 0;
+
+        std::string fingerprint() const { return "conn=" + std::to_string(connectivity); }
+        /** pieces + stitched canvas (int each) + labelling marks, per pixel */
+        uint64_t state_bytes(const DatasetInfo& info) const {
+            return static_cast<uint64_t>(info.width) * info.height * (2 * sizeof(int) + 1);
+        }
+
+        uint64_t valid_pixels() const { return valid; }
+        void init(const DatasetInfo& info);
+        void accumulate(const Block& blk);
+        void merge(LsiReducer&& o);
+        void finalize(double* out);
+    };
+
+    // ---------------------------
+    // Joint: co-occurrence of two categorical layers (see reduce_pair)
+    // ---------------------------
+    struct JointReducer {
+        /** H(A), H(B), joint entropy H(A,B), mutual information, Cramer's V */
+        static constexpr int metrics = 5;
+
+        /** Sparse table over all class pairs found. */
+        JointReducer() = default;
+        /** Dense na x nb table over fixed classes; pixels of other classes are not counted.
+         *  Throws std::invalid_argument when only one layer has classes. */
+        JointReducer(const std::vector<double>& classes_a, const std::vector<double>& classes_b) {
+            if (classes_a.empty() != classes_b.empty())
+                throw std::invalid_argument("JointReducer: classes given for one layer only");
+            for (size_t i = 0; i < classes_a.size(); ++i) lut_a[std::llround(classes_a[i])] = static_cast<int>(i);
+            for (size_t i = 0; i < classes_b.size(); ++i) lut_b[std::llround(classes_b[i])] = static_cast<int>(i);
+            na = static_cast<int>(classes_a.size());
+            nb = static_cast<int>(classes_b.size());
+            counts.assign(static_cast<size_t>(na) * nb, 0);
+        }
+
+        struct PairHash {
+            size_t operator()(const std::pair<long long, long long>& k) const {
+                return std::hash<long long>()(k.first * 0x9E3779B97F4A7C15ll ^ k.second);
+            }
+        };
+
+        std::unordered_map<std::pair<long long, long long>, uint64_t, PairHash> pairs;  // free classes
+        std::unordered_map<long long, int> lut_a, lut_b;   // fixed classes -> row / column
+        int na = 0, nb = 0;
+        std::vector<uint64_t> counts;   // fixed classes, row-major [a][b]
+        uint64_t total = 0;   // pixels counted into pairs / counts
+        uint64_t valid = 0;   // pixels valid in both layers, counted or not
+
+        std::string fingerprint() const {
+            if (lut_a.empty() && lut_b.empty()) return "all";
+            auto list = [](const std::unordered_map<long long, int>& lut, int n) {
+                std::vector<long long> classes(n);
+                for (const auto& kv : lut) classes[kv.second] = kv.first;
+                std::string s;
+                for (long long c : classes) s += std::to_string(c) + ",";
+                return s;
+            };
+            return "a=" + list(lut_a, na) + "b=" + list(lut_b, nb);
+        }
+
+        uint64_t valid_pixels() const { return valid; }
+        void init(const DatasetInfo&) {
+            pairs.clear();
+            std::fill(counts.begin(), counts.end(), 0);
+            total = valid = 0;
+        }
+
+        /** blk.bands == 2: the plane of A, then the plane of B. */
+        void accumulate(const Block& blk) {
+            const size_t np = blk.pixels();
+            const double* a = blk.data;
+            const double* b = blk.data + np;
+            const bool fixed = !counts.empty() || !lut_a.empty();
+            for (size_t i = 0; i < np; ++i) {
+                if (skip_value(a[i], blk.nodata) || skip_value(b[i], blk.nodata)) continue;
+                ++valid;
+
+                const long long ka = std::llround(a[i]), kb = std::llround(b[i]);
+                if (!fixed) { ++pairs[{ka, kb}]; ++total; continue; }
+                auto ia = lut_a.find(ka);
+                if (ia == lut_a.end()) continue;
+                auto ib = lut_b.find(kb);
+                if (ib == lut_b.end()) continue;
+                ++counts[static_cast<size_t>(ia->second) * nb + ib->second];
+                ++total;
+            }
+        }
+
+        void merge(JointReducer&& o) {
+            for (const auto& kv : o.pairs) pairs[kv.first] += kv.second;
+            for (size_t i = 0; i < counts.size(); ++i) counts[i] += o.counts[i];
+            total += o.total; valid += o.valid;
+        }
+
+        /** Natural-log entropies; Cramer's V is NaN when either layer has a single class. */
+        void finalize(double* out);
+    };
+
+} // namespace gdiv::runner
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gdiv::runner {
+
+    /** Persistent on-disk cache of finished results, shared by process_many and
+     *  the C API. Off until a directory is set.
+     *
+     *  An entry is keyed by the raster's identity (absolute path, size and
+     *  modification time) plus a tag naming the metric and every option that
+     *  changes its values. A rewritten raster therefore misses and its old
+     *  entries age out. Entries store the full key and are checked on read;
+     *  unreadable entries are deleted. When the directory grows past its cap,
+     *  the least recently used entries (by file time, refreshed on hits) are
+     *  evicted.
+     */
+
+    /** Use `dir` (created if missing) capped at max_bytes (0 = 1 GiB); empty dir disables. */
+    void set_result_cache(const std::string& dir, uint64_t max_bytes = 0);
+    bool result_cache_enabled();
+
+    /** Cache key of `path` as it is now, "" when it cannot be cached (not a local file). */
+    std::string cache_identity(const std::string& path, const std::string& tag);
+
+    /** Values stored under `identity`; false on a miss. */
+    bool cache_lookup(const std::string& identity, std::vector<double>& values);
+    /** Callers take `identity` before computing and check it again before
+     *  storing (a raster rewritten meanwhile must not be cached under it).
+     */
+    void cache_store(const std::string& identity, const std::vector<double>& values);
+
+    /** Delete every entry of the configured directory. */
+    void clear_result_cache();
+
+} // namespace gdiv::runner
@@ -1,34 +1,871 @@
 #pragma once
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <optional>
 #include <functional>
+#include <stdexcept>
+#include <atomic>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include "buffer.h"
 #include "gdal_io.h"
+#include "journal.h"
+#include "memory_budget.h"
+#include "pipeline.h"
+#include "points.h"
+#include "reducer.h"
+#include "result_cache.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "trace.h"
+#include "tiler.h"
+#include "windows.h"
 
 namespace gdiv::runner {
 
     struct RunOptions {
-        int tile = 512;
-        int threads = 0; // 0 = automatic
+        int tile = 512;               // rounded to whole blocks of the file, lowered to fit a memory budget
+        TileOrder order = TileOrder::Raster;
+        int threads = 0; // 0 = automatic (one per hardware thread), split between the stages below
+        int io_threads = 0;       // readers/decoders, 0 = automatic (plan_stages)
+        int compute_threads = 0;  // reducer threads, 0 = automatic; with both 0 compressed
+                                  // rasters are read and reduced by every thread
+        int queue_depth = 0;      // decoded tile buffers in flight, 0 = 2 per thread
+        double task_cost = 64.0 * 1024 * 1024; // estimate_cost() per task when a raster is split
         std::optional<double> nodata_override;
         bool use_all_bands = false;   // example, if only 1 band, false (use the first band), if all bands, true,
         int first_band = 1;
         int band_count = 0;          // 0=all
+        std::string journal;         // resumable result log (see Journal), "" = off
+        bool cache = true;           // use the result cache when one is set (set_result_cache)
     };
 
+    /** values[(raster * bands + band) * metrics + m]
+     *  `bands` is the widest raster of the batch; band_counts[raster] says how
+     *  many of its rows are real, the rest are NaN. `stats` shows which stage
+     *  of the pipeline the batch was waiting on.
+     */
     struct Result {
+        int metrics = 1;
+        int bands = 1;
+        std::vector<int> band_counts;
         std::vector<double> values;
+        PipelineStats stats;
+
+        double at(size_t raster, int band = 0, int metric = 0) const {
+            return values[(raster * static_cast<size_t>(bands) + band) * metrics + metric];
+        }
     };
 
+    /** Worker count actually used for `jobs` independent rasters. */
+    int resolve_threads(int requested, size_t jobs);
+
+    /** Closes the pooled datasets of the calling thread and of every parked
+     *  worker thread (e.g. before a file is rewritten). Workers busy in a run
+     *  on another thread keep theirs.
+     */
+    void close_pooled_datasets();
+
+    namespace detail {
+        /** Run body(worker) on n worker threads (n == 1: calling thread).
+         *  Workers are parked between calls and reused, so their dataset pools
+         *  persist. All workers finish before the first exception is rethrown.
+         */
+        void run_workers(int n, const std::function<void(int)>& body);
+
+        int band_count(const RunOptions& opt, const DatasetInfo& info);
+
+        /** Same geotransform (origin to a tenth of a pixel), or at least one without any. */
+        bool same_grid(GDALDataset* a, GDALDataset* b);
+
+        /** Reducer type plus its fingerprint() when it has one. */
+        template <class R, class = void>
+        struct has_fingerprint : std::false_type {};
+        template <class R>
+        struct has_fingerprint<R, std::void_t<decltype(std::declval<const R&>().fingerprint())>>
+            : std::true_type {};
+
+        template <class R>
+        std::string reducer_tag(const R& r) {
+            std::string tag = typeid(R).name();
+            if constexpr (has_fingerprint<R>::value) tag += "(" + r.fingerprint() + ")";
+            return tag;
+        }
+
+        /** Everything that changes a run's values: reducer, metrics, band and nodata options. */
+        std::string run_tag(const std::string& reducer, int metrics, const RunOptions& opt);
+
+        /** Optional `uint64_t state_bytes(const DatasetInfo&) const`: peak bytes
+         *  a reducer holds for one band of a whole raster (admitted against the
+         *  memory budget).
+         */
+        template <class R, class = void>
+        struct has_state_bytes : std::false_type {};
+        template <class R>
+        struct has_state_bytes<R, std::void_t<decltype(std::declval<const R&>().state_bytes(std::declval<const DatasetInfo&>()))>>
+            : std::true_type {};
+
+        /** Optional `uint64_t valid_pixels() const`, added to the current stats
+         *  once per finished reducer.
+         */
+        template <class R, class = void>
+        struct has_valid_pixels : std::false_type {};
+        template <class R>
+        struct has_valid_pixels<R, std::void_t<decltype(std::declval<const R&>().valid_pixels())>>
+            : std::true_type {};
+
+        template <class R>
+        void count_valid(const std::vector<R>& reds) {
+            if constexpr (has_valid_pixels<R>::value) {
+                if (!current_stats()) return;
+                uint64_t n = 0;
+                for (const R& r : reds) n += r.valid_pixels();
+                stats_add(Counter::Valid, n);
+            }
+        }
+
+        /** Bands per tile to plan buffers for; opens the first raster to be read
+         *  only when all bands are selected under a memory budget.
+         */
+        int planned_bands(const std::vector<std::string>& rasters, const std::vector<bool>& skip,
+                          const RunOptions& opt);
+
+        /** Chunks the rasters not in `skip` are cut into at opt.tile, counted only
+         *  when there are fewer rasters than threads (else the raster count).
+         */
+        size_t planned_tasks(const std::vector<std::string>& rasters, const std::vector<bool>& skip,
+                             const RunOptions& opt);
+
+        /** Distinct block grids of the rasters not in `skip`, so the buffer plan
+         *  sees the tiles for_dataset() really cuts; opens them only under a
+         *  memory budget with opt.tile > 0 (empty otherwise).
+         */
+        std::vector<BlockGrid> planned_grids(const std::vector<std::string>& rasters,
+                                             const std::vector<bool>& skip, const RunOptions& opt);
+
+        /** compression_factor() of the first raster to be read, which picks the
+         *  automatic stage split; 1 when opt fixes the thread counts.
+         */
+        double planned_decode(const std::vector<std::string>& rasters, const std::vector<bool>& skip,
+                              const RunOptions& opt);
+    }
+
+    /** Process rasters as a two-stage pipeline.
+     *
+     *  Reader threads (opt.io_threads) take rasters from work-stealing queues,
+     *  largest file first, open them through their thread's pool and decode
+     *  tiles into a fixed set of opt.queue_depth buffers; when every buffer is
+     *  in flight they block, which bounds the memory held by decoded tiles.
+     *  Rasters are cut into chunks (split_count()) that idle readers steal; a
+     *  reader keeps several chunks open and reads one tile of each in turn, so
+     *  compute threads are not limited to one chunk per reader.
+     *
+     *  Compute threads (opt.compute_threads) drain the decoded tiles. Each chunk
+     *  has one reducer per selected band (copies of `proto`) and is drained by
+     *  one compute thread at a time in tile order; each band plane of the single
+     *  read goes to its own reducer as a single-band Block. The thread finishing
+     *  the last chunk of a raster merges the chunks in order and finalizes.
+     *  Chunks depend only on the raster and the tile size, so results do not
+     *  depend on thread counts, queue depth or scheduling. Without compute
+     *  threads (one thread, or compressed rasters by default) each reader
+     *  reduces its own tiles. Rows of the result follow `rasters`.
+     *
+     *  With opt.journal set, every finished raster is appended to the journal;
+     *  rasters already recorded there by an interrupted run are not read
+     *  again, and a completed run compacts the journal to one record per raster.
+     *  With a result cache configured (and opt.cache), rasters whose file and
+     *  settings are unchanged since a cached run are answered from the cache.
+     *
+     *  Under a memory budget the tile size, queue depth and automatic thread
+     *  counts come from plan_stages(); rasters of reducers with state_bytes()
+     *  are not split and are only started once their state fits the budget.
+     */
+    template <class R>
+    Result process_many(const std::vector<std::string>& rasters,
+                        const RunOptions& opt,
+                        const R& proto)
+    {
+        static_assert(std::is_copy_constructible_v<R>, "Reducer must be copyable");
+        static_assert(R::metrics > 0, "Reducer must declare metrics");
+
+        Result res;
+        res.metrics = R::metrics;
+        if (rasters.empty()) return res;
+
+        std::vector<std::vector<double>> out(rasters.size());   // bands * metrics each
+        const std::string tag = detail::run_tag(detail::reducer_tag(proto), R::metrics, opt);
+        std::unique_ptr<Journal> journal;
+        std::vector<bool> recorded(rasters.size());
+        if (!opt.journal.empty()) {
+            journal = std::make_unique<Journal>(opt.journal, tag, R::metrics);
+            for (size_t r = 0; r < rasters.size(); ++r) {
+                if (const Journal::Entry* e = journal->find(rasters[r])) {
+                    out[r] = e->values;
+                    recorded[r] = true;
+                }
+            }
+        }
+        std::vector<std::string> cache_ids;
+        if (opt.cache && result_cache_enabled()) {
+            cache_ids.resize(rasters.size());
+            for (size_t r = 0; r < rasters.size(); ++r) {
+                if (recorded[r]) continue;
+                cache_ids[r] = cache_identity(rasters[r], tag);
+                if (!cache_lookup(cache_ids[r], out[r])) continue;
+                recorded[r] = true;
+                if (journal)
+                    journal->append(rasters[r], static_cast<int>(out[r].size() / R::metrics), out[r].data());
+            }
+        }
+
+        const StagePlan plan = plan_stages(opt, detail::planned_bands(rasters, recorded, opt),
+                                           detail::planned_tasks(rasters, recorded, opt),
+                                           detail::planned_grids(rasters, recorded, opt),
+                                           detail::planned_decode(rasters, recorded, opt));
+        WorkQueues queues(plan.io);
+        seed_tasks(queues, rasters, plan.io, recorded);
+        BufferPool pool(plan.queue_depth);
+
+        struct Split;
+        // One chunk of a raster: reducers + decoded tiles waiting for them
+        struct Chunk {
+            Split* owner = nullptr;
+            size_t raster = 0;
+            std::vector<R> reds;                // per band
+            std::optional<double> nodata;
+            std::mutex m;
+            std::deque<TileBuffer*> ready;      // guarded by m
+            bool scheduled = false;             // in the ready queue or being drained
+            bool produced = false;              // reader is done with it
+        };
+        struct Split {
+            std::vector<std::unique_ptr<Chunk>> chunks;
+            std::atomic<size_t> pending{0};
+            MemoryReservation mem;              // reducer state, until finished
+        };
+        std::vector<std::unique_ptr<Split>> splits(rasters.size());
+        ReadyQueue<Chunk> ready;
+        std::atomic<int> readers{plan.io};
+
+        std::mutex stats_m;
+        std::atomic<bool> cancelled{false};
+        const auto t_start = StageClock::now();
+
+        auto cancel_all = [&] {
+            cancelled = true;
+            queues.cancel();
+            pool.cancel();
+            ready.cancel();
+        };
+        // hand c to a compute thread unless one already has it
+        auto schedule = [&](Chunk& c) {
+            if (!c.scheduled) {
+                c.scheduled = true;
+                ready.push(&c);
+            }
+        };
+
+        // last chunk of a raster: merge in chunk order, then finalize
+        auto finish_chunk = [&](Chunk& c) {
+            Split& sp = *c.owner;
+            if (sp.pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+            const size_t r = c.raster;
+            std::vector<R> acc = std::move(sp.chunks[0]->reds);
+            {
+                TraceSpan span("merge", "raster", static_cast<int64_t>(r));
+                for (size_t k = 1; k < sp.chunks.size(); ++k)
+                    for (size_t b = 0; b < acc.size(); ++b)
+                        acc[b].merge(std::move(sp.chunks[k]->reds[b]));
+            }
+            detail::count_valid(acc);
+            out[r].resize(acc.size() * R::metrics);
+            {
+                TraceSpan span("finalize", "raster", static_cast<int64_t>(r));
+                for (size_t b = 0; b < acc.size(); ++b)
+                    acc[b].finalize(out[r].data() + b * R::metrics);
+            }
+            if (journal) journal->append(rasters[r], static_cast<int>(acc.size()), out[r].data());
+            // not when the raster was rewritten while it was read
+            if (!cache_ids.empty() && !cache_ids[r].empty() && cache_identity(rasters[r], tag) == cache_ids[r])
+                cache_store(cache_ids[r], out[r]);
+            splits[r].reset();
+        };
+
+        // a reader keeps up to `lanes` chunks open and reads one tile of each in
+        // turn, so there are chunks for every compute thread to drain; reducers
+        // with whole-raster state under a budget take one raster at a time
+        const bool inline_compute = plan.compute == 0;   // one thread: readers reduce
+        const size_t lanes = (inline_compute || (detail::has_state_bytes<R>::value && memory_budget() > 0))
+                           ? 1 : static_cast<size_t>((plan.compute + plan.io - 1) / plan.io + 1);
+
+        // reduce the tiles queued on c in order; the last chunk of a raster is finished here
+        auto drain = [&](Chunk& c) {
+            for (;;) {
+                TileBuffer* tb = nullptr;
+                bool finished = false;
+                {
+                    std::lock_guard<std::mutex> lk(c.m);
+                    if (!c.ready.empty()) {
+                        tb = c.ready.front();
+                        c.ready.pop_front();
+                    } else {
+                        c.scheduled = false;
+                        finished = c.produced;
+                    }
+                }
+                if (!tb) {
+                    if (finished) finish_chunk(c);
+                    return;
+                }
+
+                Block blk;
+                blk.bands = 1;
+                blk.nodata = c.nodata;
+                blk.win = tb->win;
+                stats_add(Counter::Pixels, blk.pixels() * c.reds.size());
+                {
+                    StageTimer timer(Stage::Compute);
+                    TraceSpan span("reduce", "raster", static_cast<int64_t>(c.raster));
+                    for (size_t b = 0; b < c.reds.size(); ++b) {   // band-sequential planes
+                        blk.data = tb->data.data() + b * blk.pixels();
+                        c.reds[b].accumulate(blk);
+                    }
+                }
+                pool.release(tb);
+            }
+        };
+
+        // one open chunk of a reader
+        struct Cursor {
+            SharedDataset ds;
+            Chunk* chunk = nullptr;
+            TileRange tiles;
+            TileRange::iterator it;   // into tiles
+            int bands = 1;
+        };
+
+        auto read_stage = [&](int self, double& wait) {
+            SharedDataset ds;   // pooled per thread
+            BufferUse held;     // pool buffers this reader grew
+            size_t open_raster = rasters.size();
+            DatasetInfo info;
+            std::list<Cursor> open;
+
+            // a cursor for task; whole rasters are split first. false once cancelled
+            auto start = [&](Task& task) {
+                if (task.raster != open_raster) {   // consecutive chunks reuse the handle
+                    ds = open_pooled(rasters[task.raster]);
+                    info = describe(ds.get());
+                    open_raster = task.raster;
+                }
+                const int bands = detail::band_count(opt, info);
+
+                TileRange tiles = task.tiles;
+                if (task.chunk < 0) {
+                    auto sp = std::make_unique<Split>();
+                    size_t n = 0;
+                    if constexpr (detail::has_state_bytes<R>::value) {
+                        if (memory_budget() > 0) {
+                            // whole-raster state: one chunk, started once it fits
+                            const auto t0 = StageClock::now();
+                            {
+                                TraceSpan span("wait_memory", "raster", static_cast<int64_t>(task.raster));
+                                sp->mem = MemoryReservation(proto.state_bytes(info) * bands, &cancelled);
+                            }
+                            wait += seconds_since(t0);
+                            if (cancelled) return false;
+                            n = 1;
+                        }
+                    }
+                    tiles = TileRange::for_dataset(ds.get(), plan.tile, opt.order);
+                    if (n == 0) n = split_count(estimate_cost(info, bands), tiles.size(), opt);
+                    auto pieces = n > 1 ? tiles.chunks(n) : std::vector<TileRange>{tiles};
+                    for (size_t c = 0; c < pieces.size(); ++c) {
+                        sp->chunks.push_back(std::make_unique<Chunk>());
+                        sp->chunks.back()->owner = sp.get();
+                        sp->chunks.back()->raster = task.raster;
+                    }
+                    sp->pending = pieces.size();
+                    splits[task.raster] = std::move(sp);
+                    // keep chunk 0, publish the rest for stealing
+                    for (size_t c = pieces.size(); c-- > 1;)
+                        queues.push(self, Task{task.raster, static_cast<int>(c), pieces[c]});
+                    task.chunk = 0;
+                    tiles = pieces[0];
+                }
+
+                Chunk& c = *splits[task.raster]->chunks[task.chunk];
+                c.nodata = opt.nodata_override.has_value() ? opt.nodata_override : info.nodata;
+                c.reds.assign(bands, proto);
+                for (R& red : c.reds) red.init(info);
+
+                open.emplace_back();
+                Cursor& cur = open.back();
+                cur.ds = ds;
+                cur.chunk = &c;
+                cur.tiles = tiles;
+                cur.it = cur.tiles.begin();
+                cur.bands = bands;
+                return true;
+            };
+
+            for (;;) {
+                while (open.size() < lanes) {
+                    auto t0 = StageClock::now();
+                    Task task;
+                    bool got;
+                    {
+                        TraceSpan span("wait_task");
+                        // only wait for work when there is nothing left to read
+                        got = open.empty() ? queues.next(self, task) : queues.try_next(self, task);
+                    }
+                    wait += seconds_since(t0);
+                    if (!got) break;
+                    if (!start(task)) return;
+                }
+                if (open.empty()) return;
+
+                for (auto cur = open.begin(); cur != open.end();) {
+                    Chunk& c = *cur->chunk;
+                    if (cur->it == cur->tiles.end()) {
+                        {
+                            std::lock_guard<std::mutex> lk(c.m);
+                            c.produced = true;
+                            if (!inline_compute) schedule(c);   // an empty or drained chunk still has to be finished
+                        }
+                        if (inline_compute) drain(c);
+                        cur = open.erase(cur);
+                        queues.done();
+                        continue;
+                    }
+
+                    auto t0 = StageClock::now();
+                    TileBuffer* tb;
+                    {
+                        TraceSpan span("wait_buffer");
+                        tb = pool.acquire();   // blocks while compute is behind
+                    }
+                    wait += seconds_since(t0);
+                    if (!tb) return;                   // cancelled
+
+                    const size_t cap = tb->data.capacity();
+                    tb->data.reserve(cur->tiles.max_tile_pixels() * cur->bands);
+                    held.add((tb->data.capacity() - cap) * sizeof(double));
+                    const Window win = *cur->it;
+                    read_window(cur->ds.get(), win, tb->data.data(), opt.first_band, cur->bands);
+                    tb->win = win;
+                    ++cur->it;
+                    {
+                        std::lock_guard<std::mutex> lk(c.m);
+                        c.ready.push_back(tb);
+                        if (!inline_compute) schedule(c);
+                    }
+                    if (inline_compute) drain(c);
+                    ++cur;
+                }
+            }
+        };
+
+        auto compute_stage = [&](double& wait) {
+            for (;;) {
+                auto t0 = StageClock::now();
+                Chunk* c;
+                {
+                    TraceSpan span("wait_tile");
+                    c = ready.pop();
+                }
+                wait += seconds_since(t0);
+                if (!c) return;
+                drain(*c);
+            }
+        };
+
+        res.stats.io.threads = plan.io;
+        res.stats.compute.threads = plan.compute;
+        res.stats.queue_depth = plan.queue_depth;
+
+        detail::run_workers(plan.io + plan.compute, [&](int w) {
+            const bool reader = w < plan.io;
+            if (tracing())
+                set_trace_thread_name(reader ? "reader " + std::to_string(w)
+                                             : "compute " + std::to_string(w - plan.io));
+            const auto t0 = StageClock::now();
+            double wait = 0;
+            auto record = [&] {
+                const double life = seconds_since(t0);
+                StageStats& st = reader ? res.stats.io : res.stats.compute;
+                std::lock_guard<std::mutex> lk(stats_m);
+                st.wait_seconds += wait;
+                st.busy_seconds += life - wait;
+            };
+            try {
+                if (reader) read_stage(w, wait);
+                else compute_stage(wait);
+            } catch (...) {
+                cancel_all();
+                if (reader && --readers == 0) ready.close();
+                record();
+                throw;
+            }
+            if (reader && --readers == 0) ready.close();
+            record();
+        });
+        res.stats.wall_seconds = seconds_since(t_start);
+        if (journal) journal->compact(rasters);
+
+        // Pad to the widest raster
+        res.band_counts.resize(rasters.size());
+        for (size_t r = 0; r < rasters.size(); ++r) {
+            res.band_counts[r] = static_cast<int>(out[r].size() / R::metrics);
+            res.bands = std::max(res.bands, res.band_counts[r]);
+        }
+        const size_t row = static_cast<size_t>(res.bands) * R::metrics;
+        res.values.assign(rasters.size() * row, std::numeric_limits<double>::quiet_NaN());
+        for (size_t r = 0; r < rasters.size(); ++r)
+            std::copy(out[r].begin(), out[r].end(), res.values.begin() + r * row);
+        return res;
+    }
+
+    /** Reducers of many windows of one raster, fed in a single pass.
+     *
+     *  Each tile of plan_windows() is decoded once, all selected bands in one
+     *  read, and its pixels go to every window overlapping it. Reducers are
+     *  init()ed with the window size and get window-relative Block coordinates,
+     *  as if each window were a raster of its own. Windows outside the raster
+     *  keep freshly initialized reducers.
+     *
+     *  Runs of WINDOW_RUN_TILES tiles are shared out to opt.threads workers;
+     *  partial states are merged in tile order, so the result does not depend
+     *  on the thread count. Returned per window (input order) and selected
+     *  band, not finalized.
+     */
+    template <class R>
+    std::vector<std::vector<R>> reduce_windows(const std::string& raster,
+                                               const std::vector<Window>& windows,
+                                               const RunOptions& opt,
+                                               const R& proto)
+    {
+        static_assert(std::is_copy_constructible_v<R>, "Reducer must be copyable");
+
+        const DatasetInfo info = describe(open_pooled(raster).get());
+        const int bands = detail::band_count(opt, info);
+        const std::optional<double> nodata = opt.nodata_override.has_value() ? opt.nodata_override : info.nodata;
+        const WindowPlan plan = plan_windows(open_pooled(raster).get(), windows, opt.tile, opt.order);
+
+        auto fresh = [&](size_t w) {
+            DatasetInfo wi = info;
+            wi.width = plan.clipped[w].w;
+            wi.height = plan.clipped[w].h;
+            std::vector<R> reds(bands, proto);
+            for (R& red : reds) red.init(wi);
+            return reds;
+        };
+
+        const size_t runs = (plan.tiles.size() + WINDOW_RUN_TILES - 1) / WINDOW_RUN_TILES;
+        std::vector<std::unordered_map<uint32_t, std::vector<R>>> partial(runs);
+        std::atomic<size_t> next{0};
+        detail::run_workers(resolve_threads(opt.threads, runs), [&](int) {
+            SharedDataset ds;   // pooled per thread
+            ScratchBuffer<double> tile, part;
+            BufferUse held;
+            uint64_t fed = 0;
+            for (size_t run; (run = next.fetch_add(1)) < runs;) {
+                if (!ds) ds = open_pooled(raster);
+                auto& mine = partial[run];
+                const size_t end = std::min(plan.tiles.size(), (run + 1) * WINDOW_RUN_TILES);
+                for (size_t t = run * WINDOW_RUN_TILES; t < end; ++t) {
+                    const WindowPlan::Tile& pt = plan.tiles[t];
+                    read_window(ds.get(), pt.read, tile, opt.first_band, bands);
+                    const size_t plane = static_cast<size_t>(pt.read.w) * pt.read.h;
+
+                    StageTimer timer(Stage::Compute);
+                    TraceSpan span("reduce", "tile", static_cast<int64_t>(t));
+                    for (uint32_t w : pt.windows) {
+                        const Window& cw = plan.clipped[w];
+                        const Window ov = intersect(pt.read, cw);
+                        auto it = mine.find(w);
+                        if (it == mine.end()) it = mine.emplace(w, fresh(w)).first;
+
+                        Block blk;
+                        blk.bands = 1;
+                        blk.nodata = nodata;
+                        blk.win = Window{ov.x - cw.x, ov.y - cw.y, ov.w, ov.h};
+                        // the whole tile goes as is, a part of it is copied out
+                        const bool whole = ov.w == pt.read.w && ov.h == pt.read.h;
+                        if (!whole) part.reserve(blk.pixels());
+                        for (int b = 0; b < bands; ++b) {
+                            const double* plane_b = tile.data() + b * plane;
+                            if (whole) {
+                                blk.data = plane_b;
+                            } else {
+                                for (int r = 0; r < ov.h; ++r)
+                                    std::copy_n(plane_b + static_cast<size_t>(ov.y - pt.read.y + r) * pt.read.w
+                                                        + (ov.x - pt.read.x),
+                                                ov.w, part.data() + static_cast<size_t>(r) * ov.w);
+                                blk.data = part.data();
+                            }
+                            it->second[b].accumulate(blk);
+                        }
+                        fed += blk.pixels() * bands;
+                    }
+                    held.set((tile.capacity() + part.capacity()) * sizeof(double));
+                }
+            }
+            stats_add(Counter::Pixels, fed);
+        });
+
+        std::vector<std::vector<R>> out(windows.size());
+        TraceSpan span("merge");
+        for (auto& run : partial) {
+            for (auto& kv : run) {
+                std::vector<R>& dst = out[kv.first];
+                if (dst.empty()) { dst = std::move(kv.second); continue; }
+                for (int b = 0; b < bands; ++b) dst[b].merge(std::move(kv.second[b]));
+            }
+        }
+        for (size_t w = 0; w < out.size(); ++w) {
+            if (out[w].empty()) out[w] = fresh(w);
+            detail::count_valid(out[w]);
+        }
+        return out;
+    }
+
+    /** reduce_windows() finalized: one row per window, like process_many. */
+    template <class R>
+    Result process_windows(const std::string& raster,
+                           const std::vector<Window>& windows,
+                           const RunOptions& opt,
+                           const R& proto)
+    {
+        static_assert(R::metrics > 0, "Reducer must declare metrics");
+
+        Result res;
+        res.metrics = R::metrics;
+        if (windows.empty()) return res;
+
+        const auto t_start = StageClock::now();
+        std::vector<std::vector<R>> reds = reduce_windows(raster, windows, opt, proto);
+        res.bands = static_cast<int>(reds[0].size());
+        res.band_counts.assign(windows.size(), res.bands);
+        res.values.resize(windows.size() * res.bands * R::metrics);
+        TraceSpan span("finalize");
+        for (size_t w = 0; w < reds.size(); ++w)
+            for (int b = 0; b < res.bands; ++b)
+                reds[w][b].finalize(res.values.data() + (w * res.bands + b) * R::metrics);
+        res.stats.wall_seconds = seconds_since(t_start);
+        return res;
+    }
+
+    /** Reducers of disk neighborhoods around many points of one raster.
+     *
+     *  The disk of plan_points() is computed once; each point's reducers are
+     *  init()ed with the disk's bounding box and fed only the pixels inside
+     *  the disk (and the raster), one row segment at a time, with box-relative
+     *  Block coordinates. Points are visited along the Hilbert curve in runs
+     *  of POINT_RUN; every worker keeps a BlockCache of point_cache_bytes(),
+     *  so blocks shared by nearby points are decoded once per worker.
+     *
+     *  A point is reduced by a single worker, so results do not depend on the
+     *  thread count. Returned per point (input order) and selected band, not
+     *  finalized; points whose disk misses the raster keep fresh reducers.
+     */
+    template <class R>
+    std::vector<std::vector<R>> reduce_points(const std::string& raster,
+                                              const std::vector<GeoPoint>& points,
+                                              double radius,
+                                              const RunOptions& opt,
+                                              const R& proto)
+    {
+        static_assert(std::is_copy_constructible_v<R>, "Reducer must be copyable");
+
+        const DatasetInfo info = describe(open_pooled(raster).get());
+        const int bands = detail::band_count(opt, info);
+        const std::optional<double> nodata = opt.nodata_override.has_value() ? opt.nodata_override : info.nodata;
+        const PointPlan plan = plan_points(open_pooled(raster).get(), points, radius);
+        const Disk& disk = plan.disk;
+
+        DatasetInfo box = info;
+        box.width = disk.width();
+        box.height = disk.height();
+        std::vector<R> fresh(bands, proto);
+        for (R& red : fresh) red.init(box);
+
+        const size_t runs = (points.size() + POINT_RUN - 1) / POINT_RUN;
+        const int workers = resolve_threads(opt.threads, runs);
+        std::vector<std::vector<R>> out(points.size());
+        std::atomic<size_t> next{0};
+        detail::run_workers(workers, [&](int) {
+            SharedDataset ds;   // pooled per thread
+            std::optional<BlockCache> cache;
+            BufferUse held;
+            uint64_t fed = 0;
+            for (size_t run; (run = next.fetch_add(1)) < runs;) {
+                if (!ds) {
+                    ds = open_pooled(raster);
+                    cache.emplace(ds.get(), opt.first_band, bands, point_cache_bytes(workers));
+                }
+                TraceSpan span("reduce", "run", static_cast<int64_t>(run));
+                const int bw = cache->block_w(), bh = cache->block_h();
+                const size_t end = std::min(points.size(), (run + 1) * POINT_RUN);
+                for (size_t k = run * POINT_RUN; k < end; ++k) {
+                    const uint32_t i = plan.order[k];
+                    const int cx = plan.px[i], cy = plan.py[i];
+                    std::vector<R> reds = fresh;
+
+                    Block blk;
+                    blk.bands = 1;
+                    blk.nodata = nodata;
+                    for (const Disk::Span& s : disk.spans) {
+                        const int y = cy + s.dy;
+                        if (y < 0 || y >= info.height) continue;
+                        const int x0 = std::max(0, cx + s.dx0);
+                        const int x1 = std::min(info.width, cx + s.dx0 + s.len);
+                        for (int bx = x0 / bw; x0 < x1 && bx <= (x1 - 1) / bw; ++bx) {
+                            Window bwin;
+                            const double* data = cache->get(bx, y / bh, bwin);
+                            const int sx0 = std::max(x0, bwin.x), sx1 = std::min(x1, bwin.x + bwin.w);
+                            const size_t plane = static_cast<size_t>(bwin.w) * bwin.h;
+                            const size_t at = static_cast<size_t>(y - bwin.y) * bwin.w + (sx0 - bwin.x);
+                            blk.win = Window{sx0 - (cx - disk.rx), s.dy + disk.ry, sx1 - sx0, 1};
+                            StageTimer timer(Stage::Compute);
+                            for (int b = 0; b < bands; ++b) {
+                                blk.data = data + b * plane + at;
+                                reds[b].accumulate(blk);
+                            }
+                            fed += blk.pixels() * bands;
+                        }
+                    }
+                    detail::count_valid(reds);
+                    out[i] = std::move(reds);
+                }
+                held.set(cache->bytes());
+            }
+            stats_add(Counter::Pixels, fed);
+        });
+        return out;
+    }
+
+    /** reduce_points() finalized: one row per point, like process_many. */
+    template <class R>
+    Result process_points(const std::string& raster,
+                          const std::vector<GeoPoint>& points,
+                          double radius,
+                          const RunOptions& opt,
+                          const R& proto)
+    {
+        static_assert(R::metrics > 0, "Reducer must declare metrics");
+
+        Result res;
+        res.metrics = R::metrics;
+        if (points.empty()) return res;
+
+        const auto t_start = StageClock::now();
+        std::vector<std::vector<R>> reds = reduce_points(raster, points, radius, opt, proto);
+        res.bands = static_cast<int>(reds[0].size());
+        res.band_counts.assign(points.size(), res.bands);
+        res.values.resize(points.size() * res.bands * R::metrics);
+        TraceSpan span("finalize");
+        for (size_t p = 0; p < reds.size(); ++p)
+            for (int b = 0; b < res.bands; ++b)
+                reds[p][b].finalize(res.values.data() + (p * res.bands + b) * R::metrics);
+        res.stats.wall_seconds = seconds_since(t_start);
+        return res;
+    }
+
+    /** One reducer over two aligned rasters read in lockstep (e.g. JointReducer).
+     *
+     *  Both must have the same size; their geotransforms, when both have one,
+     *  must match. Tiles follow the blocks of `a`; for each, band
+     *  opt.first_band of both rasters is read and handed over as a two-band
+     *  Block (a's plane, then b's). Pixels equal to nodata_a / nodata_b are
+     *  turned into NaN first, so the Block has no nodata of its own.
+     *
+     *  Tiles are shared out to opt.threads workers in contiguous chunks, each
+     *  worker folding into its own copy; copies are merged in worker order.
+     *  Returned not finalized. Throws std::runtime_error for unaligned rasters.
+     */
+    template <class R>
+    R reduce_pair(const std::string& a, const std::string& b,
+                  const std::optional<double>& nodata_a, const std::optional<double>& nodata_b,
+                  const RunOptions& opt, const R& proto)
+    {
+        static_assert(std::is_copy_constructible_v<R>, "Reducer must be copyable");
+
+        const DatasetInfo ia = describe(open_pooled(a).get());
+        const DatasetInfo ib = describe(open_pooled(b).get());
+        if (ia.width != ib.width || ia.height != ib.height)
+            throw std::runtime_error("reduce_pair(): rasters differ in size");
+        if (!detail::same_grid(open_pooled(a).get(), open_pooled(b).get()))
+            throw std::runtime_error("reduce_pair(): rasters are not aligned");
+        if (opt.first_band > std::min(ia.bands, ib.bands))
+            throw std::runtime_error("reduce_pair(): first_band out of range");
+
+        const TileRange grid = TileRange::for_dataset(open_pooled(a).get(), opt.tile, opt.order);
+        const int workers = resolve_threads(opt.threads, grid.size());
+        const std::vector<TileRange> chunks = grid.chunks(static_cast<size_t>(workers) * 4);
+
+        std::vector<R> partial(workers, proto);
+        for (R& red : partial) red.init(ia);
+        std::atomic<size_t> next{0};
+        detail::run_workers(workers, [&](int w) {
+            SharedDataset da, db;   // pooled per thread
+            ScratchBuffer<double> buf;
+            BufferUse held;
+            Block blk;
+            blk.bands = 2;
+            for (size_t c; (c = next.fetch_add(1)) < chunks.size();) {
+                if (!da) { da = open_pooled(a); db = open_pooled(b); }
+                for (const Window& win : chunks[c]) {
+                    const size_t plane = static_cast<size_t>(win.w) * win.h;
+                    double* pa = buf.reserve(2 * plane);
+                    double* pb = pa + plane;
+                    held.set(buf.capacity() * sizeof(double));
+                    read_window(da.get(), win, pa, opt.first_band, 1);
+                    read_window(db.get(), win, pb, opt.first_band, 1);
+                    stats_add(Counter::Pixels, plane);
+                    StageTimer timer(Stage::Compute);
+                    TraceSpan span("reduce");
+                    const double nan = std::numeric_limits<double>::quiet_NaN();
+                    if (nodata_a) std::replace(pa, pa + plane, *nodata_a, nan);
+                    if (nodata_b) std::replace(pb, pb + plane, *nodata_b, nan);
+                    blk.data = pa;
+                    blk.win = win;
+                    partial[w].accumulate(blk);
+                }
+            }
+        });
+
+        R out = std::move(partial[0]);
+        {
+            TraceSpan span("merge");
+            for (int w = 1; w < workers; ++w) out.merge(std::move(partial[w]));
+        }
+        if constexpr (detail::has_valid_pixels<R>::value) stats_add(Counter::Valid, out.valid_pixels());
+        return out;
+    }
 
-    Result process_many(
-        const std::vector<std::string>& rasters,
-        const RunOptions& opt,
-        const std::function<void(const std::vector<double>&, int, int, int,
-                                 std::optional<double>)>& on_tile,
-        const std::function<double()>& on_finish
-    );
+    /** Same, with each raster's own nodata (opt.nodata_override for both when set). */
+    template <class R>
+    R reduce_pair(const std::string& a, const std::string& b, const RunOptions& opt, const R& proto)
+    {
+        std::optional<double> nd_a = opt.nodata_override, nd_b = opt.nodata_override;
+        if (!opt.nodata_override.has_value()) {
+            nd_a = describe(open_pooled(a).get()).nodata;
+            nd_b = describe(open_pooled(b).get()).nodata;
+        }
+        return reduce_pair(a, b, nd_a, nd_b, opt, proto);
+    }
 
+    /** SHDI per selected band over all classes found in that band. */
     Result process_many_shdi(const std::vector<std::string>& rasters,
                              const RunOptions& opt);
 
@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "gdal_io.h"
+#include "tiler.h"
+
+namespace gdiv::runner {
+
+    struct RunOptions;
+
+    /** Rough decode cost per pixel of a COMPRESSION value relative to raw data
+     *  (1 = uncompressed or empty).
+     */
+    double compression_factor(const std::string& compression);
+
+    /** Relative work of reading a raster: pixels x bands x decode factor of its
+     *  compression (1 = uncompressed). Only meaningful compared to other costs.
+     */
+    double estimate_cost(const DatasetInfo& info, int bands);
+
+    /** Unit of work: a whole raster (not opened yet), or one chunk of a split raster. */
+    struct Task {
+        size_t raster = 0;
+        int chunk = -1;      // -1 = whole raster
+        TileRange tiles;     // chunk tiles
+    };
+
+    /** Work-stealing queues, one deque per worker.
+     *  Owners push and pop at the front (chunks of the raster they just split stay
+     *  next in line, its handle stays warm); idle workers steal from the back of
+     *  other deques.
+     */
+    class WorkQueues {
+    public:
+        explicit WorkQueues(int workers);
+
+        /** Add a task to worker's deque (counts as outstanding until done()). */
+        void push(int worker, Task t);
+        /** Seed-time append to the back of worker's deque. */
+        void push_back(int worker, Task t);
+
+        /** Next task for worker: own deque first, then steal. Waits while other
+         *  workers may still split; false once everything is done or cancelled.
+         */
+        bool next(int worker, Task& t);
+        /** As next(), but false right away when nothing is queued. */
+        bool try_next(int worker, Task& t);
+
+        /** A task returned by next() has finished (after pushing its children). */
+        void done();
+
+        /** Stop handing out tasks (a worker failed). */
+        void cancel();
+
+    private:
+        struct Lane {
+            std::mutex m;
+            std::deque<Task> q;
+        };
+        void wake();
+        bool take(int worker, Task& t);
+
+        std::vector<std::unique_ptr<Lane>> lanes_;
+        std::atomic<size_t> outstanding_{0};
+        std::atomic<bool> cancelled_{false};
+
+        // idle workers sleep here until a push, the last done() or cancel()
+        std::mutex idle_m_;
+        std::condition_variable idle_cv_;
+        uint64_t epoch_ = 0;   // guarded by idle_m_
+    };
+
+    /** One task per raster, dealt round-robin largest file first.
+     *  Rasters flagged in `skip` (if given) get no task.
+     */
+    void seed_tasks(WorkQueues& queues, const std::vector<std::string>& rasters, int workers,
+                    const std::vector<bool>& skip = {});
+
+    /** Most tiles per chunk of a split raster. */
+    constexpr size_t SPLIT_TILES = 8;
+
+    /** Chunks to cut a raster of `cost` and `tiles` tiles into (1 = keep whole):
+     *  at most SPLIT_TILES tiles and about opt.task_cost each. Independent of
+     *  the thread plan, so the merge order of a raster's partial results is too.
+     */
+    size_t split_count(double cost, size_t tiles, const RunOptions& opt);
+
+} // namespace gdiv::runner
@@ -0,0 +1,118 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace gdiv::runner {
+
+    /** Where the time and bytes of one call went. Stage seconds are summed
+     *  over the threads that worked on the call, so with several workers they
+     *  can add up to more than the wall time.
+     */
+    struct CallStats {
+        double open_seconds = 0;       // GDALOpen (dataset pool misses)
+        double read_seconds = 0;       // RasterIO: block decode + conversion to Float64
+        double convert_seconds = 0;    // conversion without decode (memory-mapped files, caller buffers)
+        double compute_seconds = 0;    // reducer loops over decoded pixels
+        double label_seconds = 0;      // LSI patch labelling
+        uint64_t datasets_opened = 0;
+        uint64_t bytes_read = 0;       // pixel bytes read, in the file's data type
+        uint64_t blocks_read = 0;      // file blocks touched by reads
+        uint64_t pixels = 0;           // pixels handed to reducers
+        uint64_t pixels_valid = 0;
+        uint64_t patches = 0;          // LSI
+        uint64_t peak_buffer_bytes = 0;   // pixel buffers and LSI tables held at once
+    };
+
+    enum class Stage { Open, Read, Convert, Compute, Label, Count };
+    enum class Counter { Opened, BytesRead, BlocksRead, Pixels, Valid, Patches, Count };
+
+    /** Thread-safe accumulator for one call; workers of the call add into
+     *  the same sink.
+     */
+    class StatsSink {
+    public:
+        void add_time(Stage s, std::chrono::steady_clock::duration d) {
+            ticks_[static_cast<int>(s)].fetch_add(static_cast<uint64_t>(d.count()), std::memory_order_relaxed);
+        }
+        void add(Counter c, uint64_t n) {
+            counters_[static_cast<int>(c)].fetch_add(n, std::memory_order_relaxed);
+        }
+        /** Buffer bytes taken (+) or given back (-); keeps the high-water mark. */
+        void buffer(int64_t delta);
+
+        CallStats snapshot() const;
+
+    private:
+        std::atomic<uint64_t> ticks_[static_cast<int>(Stage::Count)] = {};
+        std::atomic<uint64_t> counters_[static_cast<int>(Counter::Count)] = {};
+        std::atomic<int64_t> live_{0};
+        std::atomic<int64_t> peak_{0};
+    };
+
+    /** Sink of the calling thread, nullptr when stats are off (the default).
+     *  Every instrumentation point checks this first, so collection costs a
+     *  thread-local load per block when disabled.
+     */
+    StatsSink* current_stats();
+
+    /** Installs `sink` on this thread until destroyed, then restores the
+     *  previous one. detail::run_workers carries the caller's sink over to
+     *  its workers.
+     */
+    class StatsScope {
+    public:
+        explicit StatsScope(StatsSink* sink);
+        ~StatsScope();
+        StatsScope(const StatsScope&) = delete;
+        StatsScope& operator=(const StatsScope&) = delete;
+
+    private:
+        StatsSink* prev_;
+    };
+
+    /** Adds its lifetime to `stage`; no clock reads when stats are off. */
+    class StageTimer {
+    public:
+        explicit StageTimer(Stage stage) : sink_(current_stats()), stage_(stage) {
+            if (sink_) t0_ = std::chrono::steady_clock::now();
+        }
+        ~StageTimer() {
+            if (sink_) sink_->add_time(stage_, std::chrono::steady_clock::now() - t0_);
+        }
+        StageTimer(const StageTimer&) = delete;
+        StageTimer& operator=(const StageTimer&) = delete;
+
+    private:
+        StatsSink* sink_;
+        Stage stage_;
+        std::chrono::steady_clock::time_point t0_;
+    };
+
+    inline void stats_add(Counter c, uint64_t n) {
+        if (StatsSink* s = current_stats()) s->add(c, n);
+    }
+
+    /** Buffer bytes held by one thread of the current call while alive;
+     *  set() follows a buffer that grows.
+     */
+    class BufferUse {
+    public:
+        explicit BufferUse(uint64_t bytes = 0) : sink_(current_stats()) { set(bytes); }
+        ~BufferUse() { set(0); }
+        BufferUse(const BufferUse&) = delete;
+        BufferUse& operator=(const BufferUse&) = delete;
+
+        void set(uint64_t bytes) {
+            if (!sink_ || bytes == held_) return;
+            sink_->buffer(static_cast<int64_t>(bytes) - static_cast<int64_t>(held_));
+            held_ = bytes;
+        }
+        void add(uint64_t bytes) { set(held_ + bytes); }
+
+    private:
+        StatsSink* sink_;
+        uint64_t held_ = 0;
+    };
+
+} // namespace gdiv::runner
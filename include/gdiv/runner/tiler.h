@@ -1,10 +1,120 @@
 #pragma once
+#include <cstdint>
+#include <iterator>
 #include <vector>
 #include "gdal_io.h"
 
 namespace gdiv::runner {
 
-    /** cut (width x height) to tile size window */
+    /** Traversal order of the tile grid */
+    enum class TileOrder {
+        Raster,    // row by row
+        Strip,     // full-width strips (striped files decode each strip once)
+        Hilbert,   // Hilbert curve over the tile grid
+        ZOrder     // Morton / Z-order curve over the tile grid
+    };
+
+    /** Raster size and band-1 block size: all for_dataset() cuts the grid from. */
+    struct BlockGrid {
+        int width = 0, height = 0;
+        int block_w = 0, block_h = 0;
+
+        static BlockGrid of(GDALDataset* ds);
+
+        bool operator<(const BlockGrid& o) const {
+            if (width != o.width) return width < o.width;
+            if (height != o.height) return height < o.height;
+            if (block_w != o.block_w) return block_w < o.block_w;
+            return block_h < o.block_h;
+        }
+        bool operator==(const BlockGrid& o) const {
+            return width == o.width && height == o.height && block_w == o.block_w && block_h == o.block_h;
+        }
+    };
+
+    /** Lazy grid of windows over a (width x height) raster.
+     *  Windows are generated on the fly in traversal order; a range can also be
+     *  a contiguous piece of that order (see chunks()).
+     */
+    class TileRange {
+    public:
+        TileRange() = default;
+        TileRange(int width, int height, int tile_w, int tile_h,
+                  TileOrder order = TileOrder::Raster);
+
+        /** Tile size rounded to whole blocks of band 1, so every window starts on
+         *  a block boundary, at about tile x tile pixels: when blocks span the
+         *  whole width (striped files) the tile gets fewer block rows, and if one
+         *  block row is still too large the width is split. Tiled blocks larger
+         *  than the tile give one block per window. tile <= 0 gives one window
+         *  for the whole raster.
+         */
+        static TileRange for_dataset(GDALDataset* ds, int tile,
+                                     TileOrder order = TileOrder::Raster);
+        static TileRange for_grid(const BlockGrid& grid, int tile,
+                                  TileOrder order = TileOrder::Raster);
+
+        class iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = Window;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const Window*;
+            using reference = Window;
+
+            iterator() = default;
+            Window operator*() const { return r_->window_at(pos_); }
+            iterator& operator++() { pos_ = r_->next_valid(pos_ + 1); return *this; }
+            iterator operator++(int) { iterator t = *this; ++*this; return t; }
+            bool operator==(const iterator& o) const { return pos_ == o.pos_; }
+            bool operator!=(const iterator& o) const { return pos_ != o.pos_; }
+
+        private:
+            friend class TileRange;
+            iterator(const TileRange* r, uint64_t pos) : r_(r), pos_(pos) {}
+            const TileRange* r_ = nullptr;
+            uint64_t pos_ = 0;
+        };
+
+        iterator begin() const { return iterator(this, next_valid(pos_begin_)); }
+        iterator end() const { return iterator(this, pos_end_); }
+
+        /** number of windows in this range */
+        size_t size() const { return count_; }
+        bool empty() const { return count_ == 0; }
+
+        /** Split into at most n contiguous pieces of (nearly) equal tile count. */
+        std::vector<TileRange> chunks(size_t n) const;
+
+        int width() const { return width_; }
+        int height() const { return height_; }
+        int tile_w() const { return tile_w_; }
+        int tile_h() const { return tile_h_; }
+        TileOrder order() const { return order_; }
+
+        /** pixels of the largest window (buffer sizing) */
+        size_t max_tile_pixels() const;
+
+    private:
+        bool cell_at(uint64_t pos, int& tx, int& ty) const;   // false: outside the grid
+        uint64_t next_valid(uint64_t pos) const;
+        Window window_at(uint64_t pos) const;
+
+        int width_ = 0, height_ = 0;
+        int tile_w_ = 0, tile_h_ = 0;
+        int cols_ = 0, rows_ = 0;
+        TileOrder order_ = TileOrder::Raster;
+        int side_ = 0;                  // curve orders: power-of-two grid side
+        uint64_t pos_begin_ = 0, pos_end_ = 0;
+        size_t count_ = 0;
+    };
+
+    /** Position of cell (x, y) along the Hilbert curve of a side x side grid
+     *  (side a power of two); the inverse of the Hilbert TileOrder walk.
+     */
+    uint64_t hilbert_index(int side, int x, int y);
+
+    /** cut (width x height) to tile size window (materialized, raster order, not block aligned) */
     std::vector<Window> make_tiles(int width, int height, int tile);
 
 } // namespace gdiv::runner
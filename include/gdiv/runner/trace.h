@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace gdiv::runner {
+
+    /** Opt-in timeline of runner and worker activity, written as Chrome trace
+     *  JSON (chrome://tracing, https://ui.perfetto.dev).
+     *
+     *  While tracing, every thread records its spans (open, read_window,
+     *  reduce, merge, finalize, and the waits of the pipeline stages) into a
+     *  ring of its own: recording takes no lock, and when a ring is full the
+     *  oldest spans are overwritten. Rings of finished threads are reused by
+     *  new ones, so memory stays at about one ring per concurrent thread.
+     *  Off by default; then a span costs one relaxed atomic load.
+     *
+     *  start_trace() and write_trace() must not overlap traced work.
+     */
+
+    /** Drops earlier spans and starts recording, `events_per_thread` per ring. */
+    void start_trace(size_t events_per_thread = size_t(1) << 16);
+
+    /** Stops recording (spans already recorded are kept until the next start). */
+    void stop_trace();
+
+    /** Writes the recorded spans as Chrome trace JSON; false if the file cannot be written. */
+    bool write_trace(const std::string& path);
+
+    /** Name of the calling thread's track in the trace (e.g. "reader 0"). */
+    void set_trace_thread_name(const std::string& name);
+
+    namespace detail {
+        extern std::atomic<bool> g_tracing;
+
+        void trace_record(const char* name, const char* arg_name, int64_t arg,
+                          std::chrono::steady_clock::time_point t0,
+                          std::chrono::steady_clock::time_point t1);
+    }
+
+    inline bool tracing() { return detail::g_tracing.load(std::memory_order_relaxed); }
+
+    /** Records its lifetime as one span; `name` and `arg_name` must be string
+     *  literals (they are kept by pointer).
+     */
+    class TraceSpan {
+    public:
+        explicit TraceSpan(const char* name, const char* arg_name = nullptr, int64_t arg = 0)
+            : name_(tracing() ? name : nullptr), arg_name_(arg_name), arg_(arg) {
+            if (name_) t0_ = std::chrono::steady_clock::now();
+        }
+        ~TraceSpan() {
+            if (name_) detail::trace_record(name_, arg_name_, arg_, t0_, std::chrono::steady_clock::now());
+        }
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+
+    private:
+        const char* name_;
+        const char* arg_name_;
+        int64_t arg_;
+        std::chrono::steady_clock::time_point t0_;
+    };
+
+} // namespace gdiv::runner
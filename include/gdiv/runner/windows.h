@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "gdal_io.h"
+#include "tiler.h"
+
+namespace gdiv::runner {
+
+    /** Rectangle in the georeferenced units of a raster. */
+    struct GeoRect {
+        double xmin = 0, ymin = 0, xmax = 0, ymax = 0;
+    };
+
+    /** Pixel windows of georeferenced rectangles: every pixel whose area
+     *  overlaps the rectangle. Throws for rotated or missing geotransforms.
+     */
+    std::vector<Window> geo_windows(GDALDataset* ds, const std::vector<GeoRect>& rects);
+
+    /** Decode plan for many windows of one raster.
+     *
+     *  The raster is cut into block-aligned tiles (TileRange::for_dataset); only
+     *  tiles some window touches are kept, in the tile traversal order, and each
+     *  reads just the blocks its windows cover. Tiles do not overlap, so every
+     *  block is decoded once however many windows share it.
+     */
+    struct WindowPlan {
+        struct Tile {
+            Window read;                      // block-aligned area decoded
+            std::vector<uint32_t> windows;    // windows overlapping it
+        };
+        std::vector<Window> clipped;          // input windows clipped to the raster (w or h 0: outside)
+        std::vector<Tile> tiles;
+    };
+
+    /** Consecutive plan tiles per work item of reduce_windows(). */
+    inline constexpr size_t WINDOW_RUN_TILES = 8;
+
+    WindowPlan plan_windows(GDALDataset* ds, const std::vector<Window>& windows,
+                            int tile, TileOrder order = TileOrder::Raster);
+
+    /** Overlap of two windows (w = h = 0 when they do not meet). */
+    Window intersect(const Window& a, const Window& b);
+
+} // namespace gdiv::runner
@@ -16,9 +16,100 @@ extern "C" {
         uint64_t max_bytes_simple;   // full-read threshold in bytes (0 -> default 256MB)
     } RasterOptions;
 
+    // Element types of caller-owned buffers
+    enum {
+        GDIV_DT_UINT8   = 1,
+        GDIV_DT_INT8    = 2,   // GDAL 3.7+ (100 on older GDAL)
+        GDIV_DT_UINT16  = 3,
+        GDIV_DT_INT16   = 4,
+        GDIV_DT_UINT32  = 5,
+        GDIV_DT_INT32   = 6,
+        GDIV_DT_FLOAT32 = 7,
+        GDIV_DT_FLOAT64 = 8
+    };
+
+    // A single-band raster in caller memory (e.g. a C-contiguous or row-strided NumPy array)
+    typedef struct RasterBuffer {
+        const void* data;        // first pixel of row 0
+        int         width;
+        int         height;
+        int64_t     stride;      // bytes from one row to the next (0 = width * element size; may be negative)
+        int         dtype;       // GDIV_DT_*
+        double      nodata;      // used when has_nodata (RasterOptions nodata still takes precedence)
+        int         has_nodata;
+    } RasterBuffer;
+
+    // Arrow C Data Interface (https://arrow.apache.org/docs/format/CDataInterface.html)
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+    struct ArrowSchema {
+        const char* format;
+        const char* name;
+        const char* metadata;
+        int64_t flags;
+        int64_t n_children;
+        struct ArrowSchema** children;
+        struct ArrowSchema* dictionary;
+        void (*release)(struct ArrowSchema*);
+        void* private_data;
+    };
+
+    struct ArrowArray {
+        int64_t length;
+        int64_t null_count;
+        int64_t offset;
+        int64_t n_buffers;
+        int64_t n_children;
+        const void** buffers;
+        struct ArrowArray** children;
+        struct ArrowArray* dictionary;
+        void (*release)(struct ArrowArray*);
+        void* private_data;
+    };
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+    // Metrics of gdiv_calculate_batch
+    enum {
+        GDIV_METRIC_MSR  = 1,   // columns: mean, var, min, max, valid
+        GDIV_METRIC_SHDI = 2,   // columns: shdi, p[0..n_classes-1], valid
+        GDIV_METRIC_LSI  = 3    // columns: lsi, valid
+    };
+
+    typedef struct MetricSpec {
+        int           metric;      // GDIV_METRIC_*
+        const double* classes;     // SHDI class codes
+        int           n_classes;   // SHDI: > 0
+    } MetricSpec;
+
+    // Where the time of one gdiv_calculate_* call went (see gdiv_set_stats).
+    // Stage seconds are summed over the call's worker threads, so on a parallel
+    // call they can add up to more than total_seconds.
+    typedef struct GdivStats {
+        double   total_seconds;       // wall time of the call
+        double   open_seconds;        // GDALOpen (open-handle cache misses)
+        double   read_seconds;        // RasterIO: block decode + conversion to Float64
+        double   convert_seconds;     // conversion without decode (memory-mapped files, buffers)
+        double   compute_seconds;     // per-pixel metric loops
+        double   label_seconds;       // LSI patch labelling
+        uint64_t datasets_opened;
+        uint64_t bytes_read;          // pixel bytes read, in the file's data type
+        uint64_t blocks_read;         // file blocks touched by reads
+        uint64_t pixels_valid;
+        uint64_t pixels_invalid;      // NoData / non-finite
+        uint64_t patches;             // LSI
+        uint64_t peak_buffer_bytes;   // pixel buffers and LSI tables held at once
+    } GdivStats;
+
     // exports...
     GDIV_API int gdiv_calculate_msr(const char* path, const RasterOptions* opt,
                                     double* mean, double* stdv, double* vmin, double* vmax, uint64_t* valid);
+    // probs: n_classes entries; n_classes must be > 0 (100 otherwise)
     GDIV_API int gdiv_calculate_shdi(const char* path,
                                      const double* classes, int n_classes,
                                      const RasterOptions* opt,
@@ -26,6 +117,153 @@ extern "C" {
     GDIV_API int gdiv_calculate_lsi(const char* path,
                                     const RasterOptions* opt,
                                     double* out_lsi, uint64_t* out_valid);
+    // Same as gdiv_calculate_lsi, also writes patch ids (UInt32, 0 = NoData) to a tiled GeoTIFF.
+    // The ids are held for the whole raster (4 bytes per pixel) until the scan ends; a file
+    // that could not be written completely is deleted (4).
+    GDIV_API int gdiv_calculate_lsi_labels(const char* path,
+                                           const RasterOptions* opt,
+                                           const char* labels_path,
+                                           double* out_lsi, uint64_t* out_valid);
+
+    // Every metric of `specs` for every path, on opt->threads workers (0 = one per core).
+    // results: n_paths rows of gdiv_batch_columns(specs) doubles, each row the specs'
+    //          columns in order; cells that fail are NaN.
+    // status:  n_paths * n_specs codes (row = path), as returned by gdiv_calculate_*.
+    // Returns 0 when the batch ran (check status per cell), 100 on bad arguments.
+    GDIV_API int gdiv_calculate_batch(const char* const* paths, int n_paths,
+                                      const MetricSpec* specs, int n_specs,
+                                      const RasterOptions* opt,
+                                      double* results, int* status);
+    // Row width of gdiv_calculate_batch results, -1 if a spec is invalid
+    GDIV_API int gdiv_batch_columns(const MetricSpec* specs, int n_specs);
+
+    // Every metric of `specs` for many rectangles of one raster (e.g. sites in a mosaic),
+    // in one pass: each block is decoded once and feeds every rectangle overlapping it.
+    // windows: n_windows * 4 ints (x, y, width, height) in pixels; the part outside the
+    //          raster is ignored (entirely outside: status 3, width or height <= 0: 100).
+    // results / status: one row per rectangle, as in gdiv_calculate_batch.
+    // opt->win_size is the decode tile (0 = 512, rounded to blocks), opt->threads the workers.
+    // Returns 0 when the rectangles ran, 1 if the raster cannot be opened, 100 on bad arguments.
+    GDIV_API int gdiv_calculate_windows(const char* path, const int* windows, int n_windows,
+                                        const MetricSpec* specs, int n_specs,
+                                        const RasterOptions* opt,
+                                        double* results, int* status);
+    // Same with georeferenced rectangles: n_rects * 4 doubles (xmin, ymin, xmax, ymax) in the
+    // raster's CRS; every pixel touching a rectangle counts. 100 if the raster has no
+    // north-up geotransform.
+    GDIV_API int gdiv_calculate_geo_windows(const char* path, const double* rects, int n_rects,
+                                            const MetricSpec* specs, int n_specs,
+                                            const RasterOptions* opt,
+                                            double* results, int* status);
+
+    // Every metric of `specs` in a disk around each point of one raster (e.g. sample plots).
+    // xy: n_points * 2 doubles (x, y) in the raster's CRS; the disk holds the pixels whose
+    //     centers are within `radius` (CRS units) of the center of the point's pixel.
+    //     Nearby points are visited together and share decoded blocks.
+    // results / status: one row per point, as in gdiv_calculate_batch (disk entirely
+    //     outside the raster or without valid pixels: status 3).
+    // Returns 0 when the points ran, 1 if the raster cannot be opened, 100 on bad arguments,
+    // a NaN or infinite coordinate, radius <= 0 or a raster without a north-up geotransform.
+    GDIV_API int gdiv_calculate_points(const char* path, const double* xy, int n_points, double radius,
+                                       const MetricSpec* specs, int n_specs,
+                                       const RasterOptions* opt,
+                                       double* results, int* status);
+
+    // Co-occurrence of two aligned categorical rasters (same size and grid, band 1 of each),
+    // read in lockstep in one pass; a pixel counts when it is valid in both.
+    // classes_a / classes_b: fixed classes of each layer (pairs with other classes are not
+    //     counted), or both NULL / 0 for every class pair found.
+    // out:   5 doubles: H(A), H(B), joint entropy H(A,B), mutual information (natural log),
+    //        Cramer's V (NaN when a layer has a single class).
+    // table: n_a * n_b pair counts, row-major [a][b]; fixed classes only, may be NULL.
+    // Returns 0, 1 (open), 3 (no counted pixel), 100 (bad args, rasters not aligned), 9.
+    GDIV_API int gdiv_calculate_joint(const char* path_a, const char* path_b,
+                                      const double* classes_a, int n_a,
+                                      const double* classes_b, int n_b,
+                                      const RasterOptions* opt,
+                                      double* out, uint64_t* table, uint64_t* out_valid);
+
+    // Same metrics on a buffer instead of a file; the buffer is only read, never copied
+    // when it is Float64 (other types are converted a few rows at a time).
+    // No result cache. Return codes as for the path versions (100 = invalid buffer).
+    GDIV_API int gdiv_calculate_msr_buffer(const RasterBuffer* buf, const RasterOptions* opt,
+                                           double* mean, double* var, double* vmin, double* vmax, uint64_t* valid);
+    GDIV_API int gdiv_calculate_shdi_buffer(const RasterBuffer* buf,
+                                            const double* classes, int n_classes,
+                                            const RasterOptions* opt,
+                                            double* out_shdi, double* probs, uint64_t* out_valid);
+    GDIV_API int gdiv_calculate_lsi_buffer(const RasterBuffer* buf, const RasterOptions* opt,
+                                           double* out_lsi, uint64_t* out_valid);
+
+    // Batch columns, for the table outputs below (each name gets `prefix`, may be NULL):
+    //   MSR: mean var min max msr_valid | SHDI: shdi cls<code>_p... shdi_valid | LSI: lsi lsi_valid
+    // Rows start with an "id" column: ids[i], or the path when ids or ids[i] is NULL.
+    // Failed cells are empty (CSV) / null (Arrow); status (may be NULL) as in gdiv_calculate_batch.
+
+    // Run the batch and stream rows, in path order, to a CSV file as they complete.
+    // Returns 4 if the file cannot be written.
+    GDIV_API int gdiv_calculate_batch_csv(const char* const* paths, int n_paths,
+                                          const MetricSpec* specs, int n_specs,
+                                          const RasterOptions* opt,
+                                          const char* const* ids, const char* prefix,
+                                          const char* csv_path, int* status);
+
+    // Run the batch and export it as an Arrow struct array (id: utf8, metrics: float64,
+    // *_valid: uint64) through the Arrow C Data Interface, e.g. for
+    // pyarrow.RecordBatch._import_from_c(array_ptr, schema_ptr). The caller owns both
+    // structs and must call their release callbacks (importers do this).
+    GDIV_API int gdiv_calculate_batch_arrow(const char* const* paths, int n_paths,
+                                            const MetricSpec* specs, int n_specs,
+                                            const RasterOptions* opt,
+                                            const char* const* ids, const char* prefix,
+                                            struct ArrowSchema* out_schema,
+                                            struct ArrowArray* out_array, int* status);
+
+    // Open-handle cache: repeated calls on the same file reuse the parsed dataset.
+    // Handles are kept per thread, by the calling thread and by the library's
+    // worker threads, which are reused across calls; 0 disables the cache (default 0).
+    // Cached files stay open (and memory-mapped) after a call returns, which on
+    // Windows blocks overwriting or deleting them until gdiv_close_datasets.
+    // A cached file is reopened when its size or modification time changes.
+    GDIV_API void gdiv_set_dataset_cache(int max_open_per_thread);
+    // Close every cached dataset of the calling thread and of idle worker threads
+    // (e.g. before rewriting a file). Call between runs.
+    GDIV_API void gdiv_close_datasets(void);
+    // Read uncompressed GeoTIFF and raw (ENVI, EHdr, ...) files of cached datasets
+    // straight from a memory map (1) or always through GDAL (0, default). Needs the
+    // dataset cache; a mapped file must not be truncated or rewritten in place.
+    GDIV_API void gdiv_set_mapped_reads(int on);
+
+    // Result cache: repeated msr/shdi/lsi calls (and runner batches) on an unchanged
+    // file with the same options are answered from `dir` instead of a full scan.
+    // Entries are keyed by path, size, mtime and options; least recently used
+    // entries are evicted above max_bytes (0 = 1 GiB). NULL or "" disables.
+    // Returns 0 on success, 1 if the directory cannot be used.
+    GDIV_API int gdiv_set_result_cache(const char* dir, uint64_t max_bytes);
+    // Delete all cached results
+    GDIV_API void gdiv_clear_result_cache(void);
+
+    // Per-call stats: while set, every gdiv_calculate_* call made by the calling
+    // thread overwrites *stats with its own numbers (also when it fails; result
+    // cache hits show no reads). NULL turns collection off (the default), which
+    // leaves a thread-local check per block. Batch cells each read their file,
+    // so a batch counts a file once per metric.
+    GDIV_API void gdiv_set_stats(GdivStats* stats);
+
+    // Timeline trace of all threads (open, read, reduce, merge, finalize and
+    // pipeline waits) for chrome://tracing or https://ui.perfetto.dev.
+    // gdiv_start_trace drops earlier spans; each thread keeps its newest
+    // events_per_thread spans (<= 0: 65536). gdiv_stop_trace stops recording and
+    // writes the JSON; 0 on success, 4 if the file cannot be written.
+    // Start and stop between calls, not while one is running.
+    GDIV_API void gdiv_start_trace(int events_per_thread);
+    GDIV_API int gdiv_stop_trace(const char* json_path);
+
+    // Memory budget for the whole library in bytes (0 = none, the default).
+    // Split between the GDAL block cache, decoded tile buffers and per-raster
+    // tables (LSI); tile size and thread counts of batch runs are derived
+    // from it, and rasters whose tables do not fit together run one after another.
+    GDIV_API void gdiv_set_memory_budget(uint64_t bytes);
 
 #ifdef __cplusplus
 } // extern "C"
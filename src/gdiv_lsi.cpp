@@ -1,65 +1,60 @@
 #include "gdiv_lsi.h"
 #include "gdiv_utils.h"
+#include "gdiv/runner/memory_budget.h"
+#include "gdiv/runner/stats.h"
+#include "gdiv/runner/trace.h"
 
 #include <gdal_priv.h>
+#include <cpl_string.h>
 #include <vector>
 #include <queue>
 #include <limits>
 #include <cmath>
 #include <algorithm>
+#include <string>
+#include <functional>
 
 static inline size_t IDX(int x, int y, int W) { return (size_t)y * (size_t)W + (size_t)x; }
 
-// Compute mean(perimeter/sqrt(area)) across connected components (4/8 connectivity).
-int lsi_compute(const char* path,
-                const RasterOptions* opt,
-                double* out_lsi,
-                uint64_t* out_valid)
-{
-    if (!path || !out_lsi || !out_valid) return 100;
+// Label raster layout: tiled, compressed UInt32, 0 = no patch
+static const int LABEL_BLOCK = 256;
 
-    gdiv_init_gdal_once();
-    GDALDataset* ds = static_cast<GDALDataset*>(GDALOpen(path, GA_ReadOnly));
-    if (!ds) return 1;
-    GDALRasterBand* band = ds->GetRasterBand(1);
-    if (!band) { GDALClose(ds); return 1; }
+// Create the label GeoTIFF with the source georeferencing
+static GDALDataset* create_label_raster(const char* labels_path, GDALDataset* src, int W, int H) {
+    GDALDriver* drv = GetGDALDriverManager()->GetDriverByName("GTiff");
+    if (!drv) return nullptr;
 
-    const int W = band->GetXSize(), H = band->GetYSize();
+    char** co = nullptr;
+    co = CSLSetNameValue(co, "TILED", "YES");
+    co = CSLSetNameValue(co, "BLOCKXSIZE", std::to_string(LABEL_BLOCK).c_str());
+    co = CSLSetNameValue(co, "BLOCKYSIZE", std::to_string(LABEL_BLOCK).c_str());
+    co = CSLSetNameValue(co, "COMPRESS", "DEFLATE");
+    co = CSLSetNameValue(co, "PREDICTOR", "2");
+    co = CSLSetNameValue(co, "BIGTIFF", "IF_SAFER");
+    GDALDataset* out = drv->Create(labels_path, W, H, 1, GDT_UInt32, co);
+    CSLDestroy(co);
+    if (!out) return nullptr;
 
-    // Resolve NoData from file or options
-    bool hasND = false; double nd = std::numeric_limits<double>::quiet_NaN();
-    resolve_nodata(band, opt, hasND, nd);
-
-    // Read entire raster as double (avoid block/halo complexity for connectivity)
-    std::vector<double> buf((size_t)W * H);
-    if (band->RasterIO(GF_Read, 0, 0, W, H, buf.data(), W, H, GDT_Float64, 0, 0) != CE_None) {
-        GDALClose(ds);
-        return 2;
-    }
-
-    // Cast valid pixels to int; mark invalid with a sentinel
-    const int INVALID = std::numeric_limits<int>::min();
-    std::vector<int> vals(buf.size(), INVALID);
-    uint64_t valid_px = 0;
-    for (int y = 0; y < H; ++y) {
-        for (int x = 0; x < W; ++x) {
-            double v = buf[IDX(x, y, W)];
-            if (is_invalid(v, hasND, nd)) continue;
-            vals[IDX(x, y, W)] = (int)std::llround(v);
-            ++valid_px;
-        }
-    }
-    if (valid_px == 0) {
-        *out_lsi = std::numeric_limits<double>::quiet_NaN();
-        *out_valid = 0;
-        GDALClose(ds);
-        return 3;
-    }
+    double gt[6];
+    if (src->GetGeoTransform(gt) == CE_None) out->SetGeoTransform(gt);
+    const char* wkt = src->GetProjectionRef();
+    if (wkt && *wkt) out->SetProjection(wkt);
+    out->GetRasterBand(1)->SetNoDataValue(0);
+    return out;
+}
 
-    // Connectivity: derive from options (default 8)
-    const int conn = (opt ? opt->connectivity : 8);
-    const bool use8 = (conn >= 8);
+// Write label rows [y0, y1) - they are final once the scan has moved past them
+static bool flush_label_rows(GDALDataset* out, std::vector<uint32_t>& labels, int W, int y0, int y1) {
+    if (y1 <= y0) return true;
+    return out->GetRasterBand(1)->RasterIO(GF_Write, 0, y0, W, y1 - y0,
+                                           labels.data() + IDX(0, y0, W), W, y1 - y0,
+                                           GDT_UInt32, 0, 0) == CE_None;
+}
 
+// Label 4/8-connected components of equal class and sum perimeter/sqrt(area).
+bool lsi_scan(const int* vals, int W, int H, bool use8, LsiScan& out,
+              uint32_t* labels, const std::function<bool(int)>& row_done)
+{
     // Neighbors for component growth
     const int nbh4[4][2] = { {1,0},{-1,0},{0,1},{0,-1} };
     const int nbh8[8][2] = { {1,0},{-1,0},{0,1},{0,-1},{1,1},{1,-1},{-1,1},{-1,-1} };
@@ -69,22 +64,34 @@ int lsi_compute(const char* path,
     // Perimeter counting uses 4-neighborhood for stability
     const int per4[4][2] = { {1,0},{-1,0},{0,1},{0,-1} };
 
-    std::vector<char> seen(vals.size(), 0);
+    gdiv::runner::StageTimer timer(gdiv::runner::Stage::Label);
+    gdiv::runner::TraceSpan span("label");
+    // A pixel is visited once it has a label; without labels a byte map tracks it
+    std::vector<char> seen_map(labels ? 0 : (size_t)W * H, 0);
+    gdiv::runner::BufferUse held(seen_map.size());
+    auto seen = [&](size_t i) { return labels ? labels[i] != 0 : seen_map[i] != 0; };
+    auto visit = [&](size_t i, uint32_t label) {
+        if (labels) labels[i] = label;
+        else seen_map[i] = 1;
+    };
     std::queue<std::pair<int,int>> q;
 
-    long double sum_ratio = 0.0L;
-    uint64_t patch_count = 0;
-
     for (int y0 = 0; y0 < H; ++y0) {
+        // Components are seeded in scan order and never reach rows above their
+        // seed, so every row above the current scan row is final.
+        if (row_done && !row_done(y0)) return false;
+
         for (int x0 = 0; x0 < W; ++x0) {
             const size_t i0 = IDX(x0, y0, W);
             const int v0 = vals[i0];
-            if (v0 == INVALID || seen[i0]) continue;
+            if (v0 == LSI_INVALID || seen(i0)) continue;
 
             uint64_t area = 0;
             uint64_t perim = 0;
+            if (labels && out.patches >= std::numeric_limits<uint32_t>::max()) return false; // ids exhausted
+            const uint32_t label = (uint32_t)(out.patches + 1);
 
-            seen[i0] = 1;
+            visit(i0, label);
             q.push({x0, y0});
 
             while (!q.empty()) {
@@ -97,7 +104,7 @@ int lsi_compute(const char* path,
                     const int ny = y + per4[k][1];
                     if (nx < 0 || ny < 0 || nx >= W || ny >= H) { ++perim; continue; }
                     const int nv = vals[IDX(nx, ny, W)];
-                    if (nv == INVALID || nv != v0) ++perim;
+                    if (nv == LSI_INVALID || nv != v0) ++perim;
                 }
 
                 // Grow component with chosen connectivity
@@ -106,8 +113,8 @@ int lsi_compute(const char* path,
                     const int ny = y + NB[k][1];
                     if (nx < 0 || ny < 0 || nx >= W || ny >= H) continue;
                     const size_t ni = IDX(nx, ny, W);
-                    if (!seen[ni] && vals[ni] == v0) {
-                        seen[ni] = 1;
+                    if (!seen(ni) && vals[ni] == v0) {
+                        visit(ni, label);
                         q.push({nx, ny});
                     }
                 }
@@ -115,16 +122,147 @@ int lsi_compute(const char* path,
 
             if (area > 0) {
                 const long double ratio = (long double)perim / std::sqrt((long double)area);
-                sum_ratio += ratio;
-                ++patch_count;
+                out.sum_ratio += ratio;
+                ++out.patches;
             }
         }
     }
+    return !row_done || row_done(H);
+}
 
-    *out_lsi = (patch_count > 0) ? (double)(sum_ratio / (long double)patch_count)
-                                 : std::numeric_limits<double>::quiet_NaN();
+// Compute mean(perimeter/sqrt(area)) across connected components (4/8 connectivity).
+// If labels_path is given, component ids (1..N, 0 = invalid) are also written there.
+int lsi_compute(const char* path,
+                const RasterOptions* opt,
+                double* out_lsi,
+                uint64_t* out_valid,
+                const char* labels_path)
+{
+    if (!path || !out_lsi || !out_valid) return 100;
+
+    gdiv_init_gdal_once();
+    // pooled: repeated calls on the same file skip the open
+    gdiv::runner::SharedDataset ds = gdiv::runner::thread_dataset_pool().acquire(path);
+    if (!ds) return 1;
+    GDALRasterBand* band = ds->GetRasterBand(1);
+    if (!band) return 1;
+
+    const int W = band->GetXSize(), H = band->GetYSize();
+
+    // Whole class raster at once, next to the full Float64 read while it is
+    // filled (under the full-read threshold) and to the scan tables (+ labels)
+    // after: the larger pair is admitted against the memory budget
+    const size_t read_bytes = prefer_full_read(band, opt, sizeof(double)) ? sizeof(double) : 0;
+    const size_t scan_bytes = labels_path ? sizeof(uint32_t) : 1;
+    gdiv::runner::MemoryReservation mem((uint64_t)W * H * (sizeof(int) + std::max(read_bytes, scan_bytes)));
+
+    // Cast valid pixels to int window by window; invalid keep the sentinel
+    std::vector<int> vals((size_t)W * H, LSI_INVALID);
+    gdiv::runner::BufferUse held(vals.size() * sizeof(int));
+    uint64_t valid_px = 0;
+    const int rc = for_each_block_double(path, opt, [&](const gdiv::runner::Block& blk) {
+        for (int r = 0; r < blk.win.h; ++r) {
+            const double* src = blk.data + (size_t)r * blk.win.w;
+            int* dst = vals.data() + IDX(blk.win.x, blk.win.y + r, W);
+            for (int c = 0; c < blk.win.w; ++c) {
+                if (gdiv::runner::skip_value(src[c], blk.nodata)) continue;
+                dst[c] = (int)std::llround(src[c]);
+                ++valid_px;
+            }
+        }
+    });
+    if (rc) return rc;
+    gdiv::runner::stats_add(gdiv::runner::Counter::Valid, valid_px);
+    if (valid_px == 0) {
+        *out_lsi = std::numeric_limits<double>::quiet_NaN();
+        *out_valid = 0;
+        return 3;
+    }
+
+    // Connectivity: derive from options (default 8)
+    const int conn = (opt ? opt->connectivity : 8);
+    const bool use8 = (conn >= 8);
+
+    LsiScan scan;
+    if (!labels_path) {
+        lsi_scan(vals.data(), W, H, use8, scan);
+    } else {
+        // Optional label output. The label table is held whole (it doubles as the
+        // scan's visited map); finished rows are written one block row at a time
+        GDALDataset* lab_ds = create_label_raster(labels_path, ds.get(), W, H);
+        if (!lab_ds) return 4;
+        std::vector<uint32_t> labels(vals.size(), 0);
+        held.add(labels.size() * sizeof(uint32_t));
+        int flushed = 0;
+        CPLErrorReset();
+        bool ok = lsi_scan(vals.data(), W, H, use8, scan, labels.data(), [&](int y) {
+            if (y - flushed < LABEL_BLOCK && y < H) return true;
+            if (!flush_label_rows(lab_ds, labels, W, flushed, y)) return false;
+            flushed = y;
+            return true;
+        });
+        // the last compressed tiles are encoded on flush: a failure there is a failed output
+        lab_ds->FlushCache();
+        ok = ok && CPLGetLastErrorType() != CE_Failure;
+        GDALClose(lab_ds);
+        ok = ok && CPLGetLastErrorType() != CE_Failure;
+        if (!ok) {
+            if (GDALDriver* drv = GetGDALDriverManager()->GetDriverByName("GTiff")) drv->Delete(labels_path);
+            return 4;
+        }
+    }
+    gdiv::runner::stats_add(gdiv::runner::Counter::Patches, scan.patches);
+
+    *out_lsi = (scan.patches > 0) ? (double)(scan.sum_ratio / (long double)scan.patches)
+                                  : std::numeric_limits<double>::quiet_NaN();
     *out_valid = valid_px;
 
-    GDALClose(ds);
     return 0;
-}
\ No newline at end of file
+}
+
+// Same on a caller buffer (no label output)
+int lsi_compute_buffer(const RasterBuffer* buf,
+                       const RasterOptions* opt,
+                       double* out_lsi,
+                       uint64_t* out_valid)
+{
+    if (!buf || !out_lsi || !out_valid) return 100;
+    const int W = buf->width, H = buf->height;
+    gdiv::runner::MemoryReservation mem((uint64_t)W * H * (sizeof(int) + 1));
+
+    // Windows are row bands of the buffer: cast into the class canvas
+    std::vector<int> vals;
+    gdiv::runner::BufferUse held;
+    uint64_t valid_px = 0;
+    const int rc = for_each_block_buffer(buf, opt, [&](const gdiv::runner::Block& blk) {
+        if (vals.empty()) {
+            vals.assign((size_t)W * H, LSI_INVALID);
+            held.set(vals.size() * sizeof(int));
+        }
+        const size_t n = blk.pixels();
+        int* dst = vals.data() + (size_t)blk.win.y * W;
+        for (size_t i = 0; i < n; ++i) {
+            const double v = blk.data[i];
+            if (gdiv::runner::skip_value(v, blk.nodata)) continue;
+            dst[i] = (int)std::llround(v);
+            ++valid_px;
+        }
+    });
+    if (rc) return rc;
+    gdiv::runner::stats_add(gdiv::runner::Counter::Valid, valid_px);
+    if (valid_px == 0) {
+        *out_lsi = std::numeric_limits<double>::quiet_NaN();
+        *out_valid = 0;
+        return 3;
+    }
+
+    const int conn = (opt ? opt->connectivity : 8);
+    LsiScan scan;
+    lsi_scan(vals.data(), W, H, conn >= 8, scan);
+    gdiv::runner::stats_add(gdiv::runner::Counter::Patches, scan.patches);
+
+    *out_lsi = (scan.patches > 0) ? (double)(scan.sum_ratio / (long double)scan.patches)
+                                  : std::numeric_limits<double>::quiet_NaN();
+    *out_valid = valid_px;
+    return 0;
+}
@@ -1,7 +1,36 @@
 #pragma once
 #include "gdiv_toolbox.h"
+#include <cstdint>
+#include <functional>
+#include <limits>
 
+// Class value marking an invalid (NoData) pixel for lsi_scan
+constexpr int LSI_INVALID = std::numeric_limits<int>::min();
+
+struct LsiScan {
+    long double sum_ratio = 0.0L;   // sum of perimeter/sqrt(area) over patches
+    uint64_t patches = 0;
+};
+
+// Label connected components of vals (W*H, LSI_INVALID = skip), accumulating into out.
+// labels (optional, W*H, zeroed) receives patch ids 1..N and serves as the visited map,
+// so the scan allocates nothing else. row_done(y) is called before row y is
+// scanned and once with y=H; rows < y are final. Returns false if row_done fails or
+// label ids run out.
+bool lsi_scan(const int* vals, int W, int H, bool use8, LsiScan& out,
+              uint32_t* labels = nullptr,
+              const std::function<bool(int)>& row_done = nullptr);
+
+// labels_path: optional UInt32 GeoTIFF of patch ids (tiled, DEFLATE), nullptr = none
+// Return: 0=OK, 1=unable to open, 2=read failed, 3=no valid pixel, 4=label output failed
 int lsi_compute(const char* path,
                 const RasterOptions* opt,
                 double* out_lsi,
-                uint64_t* out_valid);
\ No newline at end of file
+                uint64_t* out_valid,
+                const char* labels_path = nullptr);
+
+// Same on a caller buffer, without label output
+int lsi_compute_buffer(const RasterBuffer* buf,
+                       const RasterOptions* opt,
+                       double* out_lsi,
+                       uint64_t* out_valid);
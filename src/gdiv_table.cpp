@@ -0,0 +1,213 @@
+#include "gdiv_table.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+BatchColumns batch_columns(const MetricSpec* specs, int n_specs, const char* prefix) {
+    const std::string pre = prefix ? prefix : "";
+    BatchColumns cols;
+    auto add = [&](const std::string& name, bool count) {
+        cols.names.push_back(pre + name);
+        cols.is_count.push_back(count);
+    };
+    for (int k = 0; k < n_specs; ++k) {
+        switch (specs[k].metric) {
+            case GDIV_METRIC_MSR:
+                add("mean", false); add("var", false); add("min", false); add("max", false);
+                add("msr_valid", true);
+                break;
+            case GDIV_METRIC_SHDI:
+                add("shdi", false);
+                for (int i = 0; i < specs[k].n_classes; ++i)
+                    add("cls" + std::to_string(std::llround(specs[k].classes[i])) + "_p", false);
+                add("shdi_valid", true);
+                break;
+            case GDIV_METRIC_LSI:
+                add("lsi", false);
+                add("lsi_valid", true);
+                break;
+        }
+    }
+    return cols;
+}
+
+// ---------------------------
+// CSV
+// ---------------------------
+static void append_field(std::string& line, const char* s) {
+    if (!std::strpbrk(s, ",\"\r\n")) { line += s; return; }
+    line += '"';
+    for (; *s; ++s) {
+        if (*s == '"') line += '"';
+        line += *s;
+    }
+    line += '"';
+}
+
+CsvRowWriter::~CsvRowWriter() {
+    close();
+}
+
+bool CsvRowWriter::open(const char* path, const BatchColumns& cols) {
+    fp_ = std::fopen(path, "wb");
+    if (!fp_) return false;
+    ncols_ = cols.names.size();
+    line_ = "id";
+    for (const std::string& n : cols.names) {
+        line_ += ',';
+        append_field(line_, n.c_str());
+    }
+    line_ += "\r\n";
+    ok_ = std::fputs(line_.c_str(), fp_) >= 0;
+    return ok_;
+}
+
+bool CsvRowWriter::write_row(const char* id, const double* row) {
+    if (!fp_) return false;
+    line_.clear();
+    append_field(line_, id ? id : "");
+    char num[32];
+    for (size_t c = 0; c < ncols_; ++c) {
+        line_ += ',';
+        if (std::isnan(row[c])) continue;
+        std::snprintf(num, sizeof(num), "%.17g", row[c]);
+        line_ += num;
+    }
+    line_ += "\r\n";
+    ok_ = (std::fputs(line_.c_str(), fp_) >= 0) && ok_;
+    return ok_;
+}
+
+bool CsvRowWriter::close() {
+    if (!fp_) return ok_;
+    ok_ = (std::fclose(fp_) == 0) && ok_;
+    fp_ = nullptr;
+    return ok_;
+}
+
+// ---------------------------
+// Arrow C Data Interface
+// ---------------------------
+namespace {
+
+    struct SchemaData {
+        std::string format, name;
+        std::vector<ArrowSchema> child_storage;
+        std::vector<ArrowSchema*> children;
+    };
+
+    struct ColumnData {
+        std::vector<uint8_t> validity;
+        std::vector<int32_t> offsets;     // utf8
+        std::string chars;                // utf8
+        std::vector<double> f64;
+        std::vector<uint64_t> u64;
+        const void* buffers[3] = {nullptr, nullptr, nullptr};
+        std::vector<ArrowArray> child_storage;   // struct parent only
+        std::vector<ArrowArray*> children;
+    };
+
+    void release_schema(ArrowSchema* s) {
+        if (!s || !s->release) return;
+        for (int64_t i = 0; i < s->n_children; ++i)
+            if (s->children[i]->release) s->children[i]->release(s->children[i]);
+        delete static_cast<SchemaData*>(s->private_data);
+        s->release = nullptr;
+    }
+
+    void release_array(ArrowArray* a) {
+        if (!a || !a->release) return;
+        for (int64_t i = 0; i < a->n_children; ++i)
+            if (a->children[i]->release) a->children[i]->release(a->children[i]);
+        delete static_cast<ColumnData*>(a->private_data);
+        a->release = nullptr;
+    }
+
+    void fill_schema(ArrowSchema* s, SchemaData* d, int64_t flags) {
+        s->format = d->format.c_str();
+        s->name = d->name.c_str();
+        s->metadata = nullptr;
+        s->flags = flags;
+        s->n_children = static_cast<int64_t>(d->children.size());
+        s->children = d->children.empty() ? nullptr : d->children.data();
+        s->dictionary = nullptr;
+        s->release = release_schema;
+        s->private_data = d;
+    }
+
+    void fill_array(ArrowArray* a, ColumnData* d, int64_t length, int64_t nulls, int64_t n_buffers) {
+        a->length = length;
+        a->null_count = nulls;
+        a->offset = 0;
+        a->n_buffers = n_buffers;
+        a->n_children = static_cast<int64_t>(d->children.size());
+        a->buffers = d->buffers;
+        a->children = d->children.empty() ? nullptr : d->children.data();
+        a->dictionary = nullptr;
+        a->release = release_array;
+        a->private_data = d;
+    }
+
+} // namespace
+
+void export_arrow(const BatchColumns& cols, const std::vector<std::string>& ids,
+                  const double* results, size_t n_rows,
+                  ArrowSchema* out_schema, ArrowArray* out_array)
+{
+    const size_t ncols = cols.names.size();
+    const size_t nchild = ncols + 1;
+    const int64_t len = static_cast<int64_t>(n_rows);
+
+    // schema: struct<id: utf8, col...: float64 | uint64>
+    auto root_s = std::make_unique<SchemaData>();
+    root_s->format = "+s";
+    root_s->child_storage.resize(nchild);
+    for (size_t c = 0; c < nchild; ++c) {
+        auto* d = new SchemaData();
+        d->name = c == 0 ? "id" : cols.names[c - 1];
+        d->format = c == 0 ? "u" : (cols.is_count[c - 1] ? "L" : "g");
+        fill_schema(&root_s->child_storage[c], d, ARROW_FLAG_NULLABLE);
+        root_s->children.push_back(&root_s->child_storage[c]);
+    }
+
+    auto root_a = std::make_unique<ColumnData>();
+    root_a->child_storage.resize(nchild);
+    for (auto& a : root_a->child_storage) a.release = nullptr;
+
+    {   // id
+        auto* d = new ColumnData();
+        d->offsets.reserve(n_rows + 1);
+        d->offsets.push_back(0);
+        for (size_t r = 0; r < n_rows; ++r) {
+            d->chars += ids[r];
+            d->offsets.push_back(static_cast<int32_t>(d->chars.size()));
+        }
+        d->buffers[1] = d->offsets.data();
+        d->buffers[2] = d->chars.data();
+        fill_array(&root_a->child_storage[0], d, len, 0, 3);
+    }
+    for (size_t c = 0; c < ncols; ++c) {
+        auto* d = new ColumnData();
+        d->validity.assign((n_rows + 7) / 8, 0);
+        int64_t nulls = 0;
+        if (cols.is_count[c]) d->u64.resize(n_rows);
+        else d->f64.resize(n_rows);
+        for (size_t r = 0; r < n_rows; ++r) {
+            const double v = results[r * ncols + c];
+            if (std::isnan(v)) { ++nulls; continue; }
+            d->validity[r / 8] |= static_cast<uint8_t>(1u << (r % 8));
+            if (cols.is_count[c]) d->u64[r] = static_cast<uint64_t>(v);
+            else d->f64[r] = v;
+        }
+        d->buffers[0] = nulls ? d->validity.data() : nullptr;
+        d->buffers[1] = cols.is_count[c] ? static_cast<const void*>(d->u64.data())
+                                         : static_cast<const void*>(d->f64.data());
+        fill_array(&root_a->child_storage[c + 1], d, len, nulls, 2);
+    }
+    for (auto& a : root_a->child_storage) root_a->children.push_back(&a);
+
+    fill_schema(out_schema, root_s.release(), 0);
+    fill_array(out_array, root_a.release(), len, 0, 1);
+}
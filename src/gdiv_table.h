@@ -0,0 +1,44 @@
+#pragma once
+#include "gdiv_toolbox.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Columns of a batch row, in gdiv_calculate_batch order. Names are prefix + name,
+// count columns hold pixel counts (exported as UInt64).
+struct BatchColumns {
+    std::vector<std::string> names;
+    std::vector<bool> is_count;
+};
+
+// names: mean var min max msr_valid | shdi cls<code>_p.. shdi_valid | lsi lsi_valid
+BatchColumns batch_columns(const MetricSpec* specs, int n_specs, const char* prefix);
+
+// CSV (RFC 4180) written row by row: "id" column, then the batch columns.
+// NaN (failed cell) is written as an empty field.
+class CsvRowWriter {
+public:
+    CsvRowWriter() = default;
+    ~CsvRowWriter();
+    CsvRowWriter(const CsvRowWriter&) = delete;
+    CsvRowWriter& operator=(const CsvRowWriter&) = delete;
+
+    // Create the file and write the header; false if it cannot be written
+    bool open(const char* path, const BatchColumns& cols);
+    bool write_row(const char* id, const double* row);
+    // Flush and close; false if any write failed
+    bool close();
+
+private:
+    std::FILE* fp_ = nullptr;
+    size_t ncols_ = 0;
+    bool ok_ = true;
+    std::string line_;
+};
+
+// Move n_rows x cols (row-major) into an Arrow struct array: "id" (utf8), then one
+// float64 / uint64 child per column; NaN cells become nulls. The caller owns both
+// structs and releases them through their release callbacks.
+void export_arrow(const BatchColumns& cols, const std::vector<std::string>& ids,
+                  const double* results, size_t n_rows,
+                  ArrowSchema* out_schema, ArrowArray* out_array);
@@ -1,8 +1,26 @@
 #include "gdiv_toolbox.h"
 #include "gdiv_utils.h"
+#include "gdiv_lsi.h"
+#include "gdiv_table.h"
 #include <gdal_priv.h>
 #include <cpl_error.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <cstdio>
 #include <stdexcept>
+#include <string>
+#include <vector>
+#include "gdiv/runner/result_cache.h"
+#include "gdiv/runner/runner.h"
+#include "gdiv/runner/stats.h"
+#include "gdiv/runner/trace.h"
 
 // ==========
 int msr_compute(const char* path, const RasterOptions* opt,
@@ -17,8 +35,11 @@ int shdi_compute(
   uint64_t* out_valid
 );
 
-int lsi_compute(const char* path, const RasterOptions* opt,
-                double* out_lsi, uint64_t* out_valid);
+int msr_compute_buffer(const RasterBuffer* buf, const RasterOptions* opt,
+                       double* mean, double* var, double* vmin, double* vmax, uint64_t* valid);
+
+int shdi_compute_buffer(const RasterBuffer* buf, const double* classes, int n_classes,
+                        const RasterOptions* opt, double* out_shdi, double* probs, uint64_t* out_valid);
 
 // ===========================================================
 
@@ -33,16 +54,382 @@ static void set_gdal_throw() {
     });
 }
 
+// Result cache key part: metric + the options that change its values
+static std::string options_tag(const char* metric, const RasterOptions* opt) {
+    char buf[128];
+    std::snprintf(buf, sizeof(buf), "%s conn=%d nodata=", metric, opt ? opt->connectivity : 8);
+    std::string tag = buf;
+    if (opt && opt->has_nodata) {
+        std::snprintf(buf, sizeof(buf), "%.17g", opt->nodata);
+        tag += buf;
+    } else {
+        tag += "file";
+    }
+    return tag;
+}
+
+// Answer from the result cache, or run compute() and store its values (status 0 only)
+template <class Compute, class Unpack, class Pack>
+static int cached(const char* path, const std::string& tag,
+                  Compute compute, Unpack unpack, Pack pack)
+{
+    using namespace gdiv::runner;
+    const std::string id = result_cache_enabled() ? cache_identity(path, tag) : std::string();
+    std::vector<double> vals;
+    if (!id.empty() && cache_lookup(id, vals) && unpack(vals)) return 0;
+
+    const int rc = compute();
+    // rewritten while computing: these values belong to neither version's key
+    if (rc == 0 && !id.empty() && cache_identity(path, tag) == id) {
+        vals.clear();
+        pack(vals);
+        cache_store(id, vals);
+    }
+    return rc;
+}
+
+// Cached metric calls shared by the single-path exports and the batch
+static int calc_msr(const char* path, const RasterOptions* opt,
+                    double* mean, double* var, double* vmin, double* vmax, uint64_t* valid)
+{
+    if (!path || !mean || !var || !vmin || !vmax || !valid) return 100;
+    return cached(path, options_tag("msr", opt),
+        [&]{ return msr_compute(path, opt, mean, var, vmin, vmax, valid); },
+        [&](const std::vector<double>& v) {
+            if (v.size() != 5) return false;
+            *mean = v[0]; *var = v[1]; *vmin = v[2]; *vmax = v[3]; *valid = (uint64_t)v[4];
+            return true;
+        },
+        [&](std::vector<double>& v) { v = {*mean, *var, *vmin, *vmax, (double)*valid}; });
+}
+
+static int calc_shdi(const char* path, const double* classes, int n_classes,
+                     const RasterOptions* opt, double* out_shdi, double* probs, uint64_t* out_valid)
+{
+    if (!path || !classes || !probs || n_classes <= 0 || !out_shdi || !out_valid) return 100;
+    std::string tag = options_tag("shdi", opt) + " classes=";
+    for (int i = 0; i < n_classes; ++i) tag += std::to_string(std::llround(classes[i])) + ",";
+    return cached(path, tag,
+        [&]{ return shdi_compute(path, classes, n_classes, opt, out_shdi, probs, out_valid); },
+        [&](const std::vector<double>& v) {
+            if (v.size() != (size_t)n_classes + 2) return false;
+            *out_shdi = v[0];
+            for (int i = 0; i < n_classes; ++i) probs[i] = v[1 + i];
+            *out_valid = (uint64_t)v[n_classes + 1];
+            return true;
+        },
+        [&](std::vector<double>& v) {
+            v.push_back(*out_shdi);
+            v.insert(v.end(), probs, probs + n_classes);
+            v.push_back((double)*out_valid);
+        });
+}
+
+static int calc_lsi(const char* path, const RasterOptions* opt, double* out_lsi, uint64_t* out_valid)
+{
+    if (!path || !out_lsi || !out_valid) return 100;
+    return cached(path, options_tag("lsi", opt),
+        [&]{ return lsi_compute(path, opt, out_lsi, out_valid); },
+        [&](const std::vector<double>& v) {
+            if (v.size() != 2) return false;
+            *out_lsi = v[0]; *out_valid = (uint64_t)v[1];
+            return true;
+        },
+        [&](std::vector<double>& v) { v = {*out_lsi, (double)*out_valid}; });
+}
+
+static int spec_columns(const MetricSpec& spec) {
+    switch (spec.metric) {
+        case GDIV_METRIC_MSR:  return 5;
+        case GDIV_METRIC_SHDI: return spec.n_classes > 0 ? spec.n_classes + 2 : -1;
+        case GDIV_METRIC_LSI:  return 2;
+        default:               return -1;
+    }
+}
+
+// One metric of one path into its result columns; status code like the single calls
+static int calc_spec(const char* path, const MetricSpec& spec, const RasterOptions* opt, double* out) {
+    uint64_t valid = 0;
+    int rc = 100;
+    switch (spec.metric) {
+        case GDIV_METRIC_MSR:
+            rc = calc_msr(path, opt, &out[0], &out[1], &out[2], &out[3], &valid);
+            out[4] = (double)valid;
+            break;
+        case GDIV_METRIC_SHDI:
+            rc = calc_shdi(path, spec.classes, spec.n_classes, opt, &out[0], &out[1], &valid);
+            out[spec.n_classes + 1] = (double)valid;
+            break;
+        case GDIV_METRIC_LSI:
+            rc = calc_lsi(path, opt, &out[0], &valid);
+            out[1] = (double)valid;
+            break;
+    }
+    return rc;
+}
+
+// GDAL errors of a batch worker throw on that thread only
+struct ThreadErrorThrow {
+    ThreadErrorThrow() {
+        CPLPushErrorHandler([](CPLErr, CPLErrorNum, const char* msg){
+            throw std::runtime_error(msg ? msg : "GDAL error");
+        });
+    }
+    ~ThreadErrorThrow() { CPLPopErrorHandler(); }
+};
+
+// Stats target of the calling thread (gdiv_set_stats)
+static thread_local GdivStats* t_stats = nullptr;
+
+// Fills the caller's GdivStats with everything one export call does, when set
+class StatsCollector {
+public:
+    StatsCollector() : out_(t_stats) {
+        if (!out_) return;
+        scope_.emplace(&sink_);
+        t0_ = std::chrono::steady_clock::now();
+    }
+    ~StatsCollector() {
+        if (!out_) return;
+        scope_.reset();
+        const gdiv::runner::CallStats st = sink_.snapshot();
+        GdivStats& o = *out_;
+        o.total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0_).count();
+        o.open_seconds = st.open_seconds;
+        o.read_seconds = st.read_seconds;
+        o.convert_seconds = st.convert_seconds;
+        o.compute_seconds = st.compute_seconds;
+        o.label_seconds = st.label_seconds;
+        o.datasets_opened = st.datasets_opened;
+        o.bytes_read = st.bytes_read;
+        o.blocks_read = st.blocks_read;
+        o.pixels_valid = st.pixels_valid;
+        o.pixels_invalid = st.pixels > st.pixels_valid ? st.pixels - st.pixels_valid : 0;
+        o.patches = st.patches;
+        o.peak_buffer_bytes = st.peak_buffer_bytes;
+    }
+    StatsCollector(const StatsCollector&) = delete;
+    StatsCollector& operator=(const StatsCollector&) = delete;
+
+private:
+    GdivStats* out_;
+    gdiv::runner::StatsSink sink_;
+    std::optional<gdiv::runner::StatsScope> scope_;
+    std::chrono::steady_clock::time_point t0_;
+};
+
+// Row width of a batch, -1 if a spec is invalid
+static int total_columns(const MetricSpec* specs, int n_specs) {
+    if (!specs || n_specs <= 0) return -1;
+    int cols = 0;
+    for (int k = 0; k < n_specs; ++k) {
+        const int c = spec_columns(specs[k]);
+        if (c < 0) return -1;
+        cols += c;
+    }
+    return cols;
+}
+
+// The batch engine: (path, metric) cells on opt->threads workers. row_of(i) is the
+// storage of row i (total_columns wide, may be called from several workers);
+// on_row(i) is called in path order as soon as row i and every row before it are complete.
+static int run_batch(const char* const* paths, int n_paths,
+                     const MetricSpec* specs, int n_specs,
+                     const RasterOptions* opt,
+                     const std::function<double*(size_t)>& row_of, int* status,
+                     const std::function<void(size_t)>& on_row)
+{
+    const int cols = total_columns(specs, n_specs);
+    if (!paths || n_paths < 0 || cols < 0) return 100;
+    gdal_init_once();
+
+    std::vector<int> offset(n_specs, 0);
+    for (int k = 1; k < n_specs; ++k) offset[k] = offset[k - 1] + spec_columns(specs[k - 1]);
+
+    // rows complete out of order; hand them to on_row in order
+    std::unique_ptr<std::atomic<int>[]> left(new std::atomic<int>[n_paths]);
+    for (int i = 0; i < n_paths; ++i) left[i] = n_specs;
+    std::vector<char> row_done(n_paths, 0);
+    size_t next_row = 0;
+    std::mutex row_m;
+
+    // (path, metric) cells handed out in order, so a file's metrics stay together
+    const size_t cells = (size_t)n_paths * n_specs;
+    std::atomic<size_t> next{0};
+    const int workers = gdiv::runner::resolve_threads(opt ? opt->threads : 0, cells);
+    gdiv::runner::detail::run_workers(workers, [&](int) {
+        ThreadErrorThrow errors;
+        for (size_t c; (c = next.fetch_add(1)) < cells;) {
+            const size_t i = c / n_specs;
+            const int k = (int)(c % n_specs);
+            double* row = row_of(i) + offset[k];
+            std::fill(row, row + spec_columns(specs[k]), std::numeric_limits<double>::quiet_NaN());
+            int rc;
+            try {
+                gdiv::runner::TraceSpan span("cell", "path", (int64_t)i);
+                rc = calc_spec(paths[i], specs[k], opt, row);
+            } catch (...) {
+                rc = 9;
+            }
+            if (rc != 0)
+                std::fill(row, row + spec_columns(specs[k]), std::numeric_limits<double>::quiet_NaN());
+            status[c] = rc;
+
+            if (--left[i] != 0 || !on_row) continue;
+            std::lock_guard<std::mutex> lk(row_m);
+            row_done[i] = 1;
+            while (next_row < (size_t)n_paths && row_done[next_row]) on_row(next_row++);
+        }
+    });
+    return 0;
+}
+
+// Every spec of a row as one reducer, so a window's pixels are visited once for all
+struct SpecsReducer {
+    std::vector<int> metric;       // per spec
+    std::vector<size_t> slot;      // index into the vector of its metric
+    std::vector<gdiv::runner::MsrReducer> msr;
+    std::vector<gdiv::runner::ShdiReducer> shdi;
+    std::vector<gdiv::runner::LsiReducer> lsi;
+
+    SpecsReducer(const MetricSpec* specs, int n_specs, const RasterOptions* opt) {
+        for (int k = 0; k < n_specs; ++k) {
+            metric.push_back(specs[k].metric);
+            switch (specs[k].metric) {
+                case GDIV_METRIC_MSR:
+                    slot.push_back(msr.size());
+                    msr.emplace_back();
+                    break;
+                case GDIV_METRIC_SHDI:
+                    slot.push_back(shdi.size());
+                    shdi.emplace_back(std::vector<double>(specs[k].classes, specs[k].classes + specs[k].n_classes));
+                    break;
+                default:
+                    slot.push_back(lsi.size());
+                    lsi.emplace_back(opt ? opt->connectivity : 8);
+                    break;
+            }
+        }
+    }
+
+    // every spec sees the same pixels
+    uint64_t valid_pixels() const {
+        if (!msr.empty()) return msr[0].valid_pixels();
+        if (!shdi.empty()) return shdi[0].valid_pixels();
+        return lsi.empty() ? 0 : lsi[0].valid_pixels();
+    }
+
+    void init(const gdiv::runner::DatasetInfo& info) {
+        for (auto& r : msr) r.init(info);
+        for (auto& r : shdi) r.init(info);
+        for (auto& r : lsi) r.init(info);
+    }
+
+    void accumulate(const gdiv::runner::Block& blk) {
+        for (auto& r : msr) r.accumulate(blk);
+        for (auto& r : shdi) r.accumulate(blk);
+        for (auto& r : lsi) r.accumulate(blk);
+    }
+
+    void merge(SpecsReducer&& o) {
+        for (size_t i = 0; i < msr.size(); ++i) msr[i].merge(std::move(o.msr[i]));
+        for (size_t i = 0; i < shdi.size(); ++i) shdi[i].merge(std::move(o.shdi[i]));
+        for (size_t i = 0; i < lsi.size(); ++i) lsi[i].merge(std::move(o.lsi[i]));
+    }
+
+    // Columns of spec k, status code like the single calls
+    int finish(int k, double* out) {
+        const size_t i = slot[k];
+        switch (metric[k]) {
+            case GDIV_METRIC_MSR:
+                if (msr[i].n == 0) return 3;
+                msr[i].finalize(out);
+                out[4] = (double)msr[i].n;
+                return 0;
+            case GDIV_METRIC_SHDI: {
+                gdiv::runner::ShdiReducer& r = shdi[i];
+                if (r.valid == 0) return 3;
+                for (size_t c = 0; c < r.counts.size(); ++c) out[1 + c] = (double)r.counts[c] / (double)r.total;
+                r.finalize(out);
+                out[r.counts.size() + 1] = (double)r.total;
+                return 0;
+            }
+            default:
+                if (lsi[i].valid == 0) return 3;
+                lsi[i].finalize(out);
+                out[1] = (double)lsi[i].valid;
+                return 0;
+        }
+    }
+};
+
+// RunOptions of the one-raster calls (nodata resolved like the single calls); false if it cannot be opened
+static bool one_raster_options(const char* path, const RasterOptions* opt, gdiv::runner::RunOptions& ro)
+{
+    gdiv::runner::SharedDataset ds = gdiv::runner::thread_dataset_pool().acquire(path);
+    if (!ds || !ds->GetRasterBand(1)) return false;
+    bool hasND = false; double nd = 0;
+    resolve_nodata(ds->GetRasterBand(1), opt, hasND, nd);
+
+    ro.threads = opt ? opt->threads : 0;
+    ro.tile = (opt && opt->win_size > 0) ? opt->win_size : 512;
+    if (hasND) ro.nodata_override = nd;
+    return true;
+}
+
+// One results/status row per item from its first-band reducer; items with ok[i] == 0 get 100
+static void write_rows(std::vector<std::vector<SpecsReducer>>& per_item, const std::vector<char>& ok,
+                       const MetricSpec* specs, int n_specs,
+                       double* results, int* status)
+{
+    const int cols = total_columns(specs, n_specs);
+    gdiv::runner::TraceSpan span("finalize");
+    for (size_t i = 0; i < per_item.size(); ++i) {
+        double* row = results + i * cols;
+        for (int k = 0; k < n_specs; ++k) {
+            int rc = 100;
+            if (ok[i]) rc = per_item[i][0].finish(k, row);
+            if (rc != 0) std::fill(row, row + spec_columns(specs[k]), std::numeric_limits<double>::quiet_NaN());
+            status[i * n_specs + k] = rc;
+            row += spec_columns(specs[k]);
+        }
+    }
+}
+
+// Rectangles of one raster in one pass; rows and status as in run_batch
+static int run_windows(const char* path, const std::vector<gdiv::runner::Window>& wins,
+                       const MetricSpec* specs, int n_specs,
+                       const RasterOptions* opt,
+                       double* results, int* status)
+{
+    const int cols = total_columns(specs, n_specs);
+    std::fill(results, results + wins.size() * cols, std::numeric_limits<double>::quiet_NaN());
+
+    gdiv::runner::RunOptions ro;
+    if (!one_raster_options(path, opt, ro)) return 1;
+
+    std::vector<std::vector<SpecsReducer>> per_window;
+    {
+        ThreadErrorThrow errors;
+        per_window = gdiv::runner::reduce_windows(path, wins, ro, SpecsReducer(specs, n_specs, opt));
+    }
+    std::vector<char> ok(wins.size());
+    for (size_t i = 0; i < wins.size(); ++i) ok[i] = wins[i].w > 0 && wins[i].h > 0;
+    write_rows(per_window, ok, specs, n_specs, results, status);
+    return 0;
+}
+
 extern "C" {
 
     // --- MSR ---
     GDIV_API int gdiv_calculate_msr(const char* path, const RasterOptions* opt,
                                     double* mean, double* var, double* vmin, double* vmax, uint64_t* valid)
     {
+        StatsCollector stats;
         try {
             gdal_init_once();
             set_gdal_throw();
-            return msr_compute(path, opt, mean, var, vmin, vmax, valid);
+            return calc_msr(path, opt, mean, var, vmin, vmax, valid);
         } catch (...) {
             return 9;
         }
@@ -54,10 +441,11 @@ extern "C" {
                                      const RasterOptions* opt,
                                      double* out_shdi, double* probs, uint64_t* out_valid)
     {
+        StatsCollector stats;
         try {
             gdal_init_once();
             set_gdal_throw();
-            return shdi_compute(path, classes, n_classes, opt, out_shdi, probs, out_valid);
+            return calc_shdi(path, classes, n_classes, opt, out_shdi, probs, out_valid);
         } catch (...) {
             return 9;
         }
@@ -68,14 +456,361 @@ extern "C" {
                                     const RasterOptions* opt,
                                     double* out_lsi, uint64_t* out_valid)
     {
+        StatsCollector stats;
+        try {
+            gdal_init_once();
+            set_gdal_throw();
+            return calc_lsi(path, opt, out_lsi, out_valid);
+        } catch (...) {
+            return 9;
+        }
+    }
+
+    // --- LSI + patch label raster ---
+    GDIV_API int gdiv_calculate_lsi_labels(const char* path,
+                                           const RasterOptions* opt,
+                                           const char* labels_path,
+                                           double* out_lsi, uint64_t* out_valid)
+    {
+        StatsCollector stats;
+        if (!labels_path) return 100;
         try {
             gdal_init_once();
             set_gdal_throw();
-            return lsi_compute(path, opt, out_lsi, out_valid);
+            return lsi_compute(path, opt, out_lsi, out_valid, labels_path);
+        } catch (...) {
+            return 9;
+        }
+    }
+
+    // --- Caller buffers ---
+    GDIV_API int gdiv_calculate_msr_buffer(const RasterBuffer* buf, const RasterOptions* opt,
+                                           double* mean, double* var, double* vmin, double* vmax, uint64_t* valid)
+    {
+        StatsCollector stats;
+        if (!mean || !var || !vmin || !vmax || !valid) return 100;
+        try {
+            return msr_compute_buffer(buf, opt, mean, var, vmin, vmax, valid);
+        } catch (...) {
+            return 9;
+        }
+    }
+
+    GDIV_API int gdiv_calculate_shdi_buffer(const RasterBuffer* buf,
+                                            const double* classes, int n_classes,
+                                            const RasterOptions* opt,
+                                            double* out_shdi, double* probs, uint64_t* out_valid)
+    {
+        StatsCollector stats;
+        if (!classes || !probs || n_classes <= 0 || !out_shdi || !out_valid) return 100;
+        try {
+            return shdi_compute_buffer(buf, classes, n_classes, opt, out_shdi, probs, out_valid);
+        } catch (...) {
+            return 9;
+        }
+    }
+
+    GDIV_API int gdiv_calculate_lsi_buffer(const RasterBuffer* buf, const RasterOptions* opt,
+                                           double* out_lsi, uint64_t* out_valid)
+    {
+        StatsCollector stats;
+        try {
+            return lsi_compute_buffer(buf, opt, out_lsi, out_valid);
+        } catch (...) {
+            return 9;
+        }
+    }
+
+    // --- Batch ---
+    GDIV_API int gdiv_batch_columns(const MetricSpec* specs, int n_specs)
+    {
+        return total_columns(specs, n_specs);
+    }
+
+    GDIV_API int gdiv_calculate_batch(const char* const* paths, int n_paths,
+                                      const MetricSpec* specs, int n_specs,
+                                      const RasterOptions* opt,
+                                      double* results, int* status)
+    {
+        StatsCollector stats;
+        if (!results || !status) return 100;
+        try {
+            const int cols = total_columns(specs, n_specs);
+            return run_batch(paths, n_paths, specs, n_specs, opt,
+                             [&](size_t i) { return results + i * cols; }, status, nullptr);
         } catch (...) {
             return 9;
         }
     }
 
+    GDIV_API int gdiv_calculate_batch_csv(const char* const* paths, int n_paths,
+                                          const MetricSpec* specs, int n_specs,
+                                          const RasterOptions* opt,
+                                          const char* const* ids, const char* prefix,
+                                          const char* csv_path, int* status)
+    {
+        StatsCollector stats;
+        const int cols = gdiv_batch_columns(specs, n_specs);
+        if (!csv_path || !paths || n_paths < 0 || cols < 0) return 100;
+        try {
+            CsvRowWriter csv;
+            if (!csv.open(csv_path, batch_columns(specs, n_specs, prefix))) return 4;
+            // a row is held only from its first cell until it is written
+            std::vector<std::vector<double>> rows(n_paths);
+            std::mutex rows_m;
+            std::vector<int> st((size_t)n_paths * n_specs);
+            const int rc = run_batch(paths, n_paths, specs, n_specs, opt,
+                [&](size_t i) {
+                    std::lock_guard<std::mutex> lk(rows_m);
+                    if (rows[i].empty()) rows[i].resize(cols);
+                    return rows[i].data();
+                },
+                st.data(),
+                [&](size_t i) {
+                    csv.write_row((ids && ids[i]) ? ids[i] : paths[i], rows[i].data());
+                    std::vector<double>().swap(rows[i]);
+                });
+            if (status) std::copy(st.begin(), st.end(), status);
+            if (!csv.close()) return 4;
+            return rc;
+        } catch (...) {
+            return 9;
+        }
+    }
+
+    GDIV_API int gdiv_calculate_batch_arrow(const char* const* paths, int n_paths,
+                                            const MetricSpec* specs, int n_specs,
+                                            const RasterOptions* opt,
+                                            const char* const* ids, const char* prefix,
+                                            struct ArrowSchema* out_schema,
+                                            struct ArrowArray* out_array, int* status)
+    {
+        StatsCollector stats;
+        const int cols = gdiv_batch_columns(specs, n_specs);
+        if (!out_schema || !out_array || !paths || n_paths < 0 || cols < 0) return 100;
+        try {
+            std::vector<double> res((size_t)n_paths * cols);
+            std::vector<int> st((size_t)n_paths * n_specs);
+            const int rc = run_batch(paths, n_paths, specs, n_specs, opt,
+                                     [&](size_t i) { return res.data() + i * cols; }, st.data(), nullptr);
+            if (rc) return rc;
+            if (status) std::copy(st.begin(), st.end(), status);
+
+            std::vector<std::string> row_ids(n_paths);
+            for (int i = 0; i < n_paths; ++i) row_ids[i] = (ids && ids[i]) ? ids[i] : paths[i];
+            export_arrow(batch_columns(specs, n_specs, prefix), row_ids, res.data(), (size_t)n_paths,
+                         out_schema, out_array);
+            return 0;
+        } catch (...) {
+            return 9;
+        }
+    }
+
+    // --- Windows of one raster ---
+    GDIV_API int gdiv_calculate_windows(const char* path, const int* windows, int n_windows,
+                                        const MetricSpec* specs, int n_specs,
+                                        const RasterOptions* opt,
+                                        double* results, int* status)
+    {
+        StatsCollector stats;
+        if (!path || (!windows && n_windows > 0) || n_windows < 0 || !results || !status
+            || total_columns(specs, n_specs) < 0) return 100;
+        try {
+            gdal_init_once();
+            std::vector<gdiv::runner::Window> wins(n_windows);
+            for (int i = 0; i < n_windows; ++i)
+                wins[i] = {windows[4 * i], windows[4 * i + 1], windows[4 * i + 2], windows[4 * i + 3]};
+            return run_windows(path, wins, specs, n_specs, opt, results, status);
+        } catch (...) {
+            return 9;
+        }
+    }
+
+    GDIV_API int gdiv_calculate_geo_windows(const char* path, const double* rects, int n_rects,
+                                            const MetricSpec* specs, int n_specs,
+                                            const RasterOptions* opt,
+                                            double* results, int* status)
+    {
+        StatsCollector stats;
+        if (!path || (!rects && n_rects > 0) || n_rects < 0 || !results || !status
+            || total_columns(specs, n_specs) < 0) return 100;
+        try {
+            gdal_init_once();
+            gdiv::runner::SharedDataset ds = gdiv::runner::thread_dataset_pool().acquire(path);
+            if (!ds) return 1;
+            std::vector<gdiv::runner::GeoRect> geo(n_rects);
+            for (int i = 0; i < n_rects; ++i)
+                geo[i] = {rects[4 * i], rects[4 * i + 1], rects[4 * i + 2], rects[4 * i + 3]};
+            std::vector<gdiv::runner::Window> wins;
+            try {
+                wins = gdiv::runner::geo_windows(ds.get(), geo);
+            } catch (const std::runtime_error&) {
+                return 100;   // not georeferenced, or rotated
+            }
+            // outside the raster: a pixel window off the edge gives status 3, not 100
+            for (auto& w : wins) if (w.w <= 0) w = {-1, -1, 1, 1};
+            return run_windows(path, wins, specs, n_specs, opt, results, status);
+        } catch (...) {
+            return 9;
+        }
+    }
+
+    // --- Points of one raster ---
+    GDIV_API int gdiv_calculate_points(const char* path, const double* xy, int n_points, double radius,
+                                       const MetricSpec* specs, int n_specs,
+                                       const RasterOptions* opt,
+                                       double* results, int* status)
+    {
+        StatsCollector stats;
+        if (!path || (!xy && n_points > 0) || n_points < 0 || !(radius > 0) || !results || !status
+            || total_columns(specs, n_specs) < 0) return 100;
+        for (int i = 0; i < 2 * n_points; ++i)
+            if (!std::isfinite(xy[i])) return 100;
+        try {
+            gdal_init_once();
+            const int cols = total_columns(specs, n_specs);
+            std::fill(results, results + (size_t)n_points * cols, std::numeric_limits<double>::quiet_NaN());
+
+            gdiv::runner::RunOptions ro;
+            if (!one_raster_options(path, opt, ro)) return 1;
+            {
+                gdiv::runner::SharedDataset ds = gdiv::runner::thread_dataset_pool().acquire(path);
+                double gt[6];
+                if (ds->GetGeoTransform(gt) != CE_None || gt[2] != 0.0 || gt[4] != 0.0
+                    || gt[1] == 0.0 || gt[5] == 0.0) return 100;
+            }
+
+            std::vector<gdiv::runner::GeoPoint> pts(n_points);
+            for (int i = 0; i < n_points; ++i) pts[i] = {xy[2 * i], xy[2 * i + 1]};
+            std::vector<std::vector<SpecsReducer>> per_point;
+            {
+                ThreadErrorThrow errors;
+                per_point = gdiv::runner::reduce_points(path, pts, radius, ro, SpecsReducer(specs, n_specs, opt));
+            }
+            write_rows(per_point, std::vector<char>(pts.size(), 1), specs, n_specs, results, status);
+            return 0;
+        } catch (...) {
+            return 9;
+        }
+    }
+
+    // --- Two aligned rasters ---
+    GDIV_API int gdiv_calculate_joint(const char* path_a, const char* path_b,
+                                      const double* classes_a, int n_a,
+                                      const double* classes_b, int n_b,
+                                      const RasterOptions* opt,
+                                      double* out, uint64_t* table, uint64_t* out_valid)
+    {
+        StatsCollector stats;
+        const bool fixed = n_a > 0 || n_b > 0;
+        if (!path_a || !path_b || !out || n_a < 0 || n_b < 0) return 100;
+        if (fixed && (n_a == 0 || n_b == 0 || !classes_a || !classes_b)) return 100;
+        if (table && !fixed) return 100;
+        try {
+            gdal_init_once();
+            std::fill(out, out + gdiv::runner::JointReducer::metrics, std::numeric_limits<double>::quiet_NaN());
+            if (out_valid) *out_valid = 0;
+
+            gdiv::runner::SharedDataset da = gdiv::runner::thread_dataset_pool().acquire(path_a);
+            gdiv::runner::SharedDataset db = gdiv::runner::thread_dataset_pool().acquire(path_b);
+            if (!da || !da->GetRasterBand(1) || !db || !db->GetRasterBand(1)) return 1;
+            if (da->GetRasterXSize() != db->GetRasterXSize() || da->GetRasterYSize() != db->GetRasterYSize()
+                || !gdiv::runner::detail::same_grid(da.get(), db.get())) return 100;
+
+            bool hasA = false, hasB = false; double ndA = 0, ndB = 0;
+            resolve_nodata(da->GetRasterBand(1), opt, hasA, ndA);
+            resolve_nodata(db->GetRasterBand(1), opt, hasB, ndB);
+            gdiv::runner::RunOptions ro;
+            ro.threads = opt ? opt->threads : 0;
+            ro.tile = (opt && opt->win_size > 0) ? opt->win_size : 512;
+
+            gdiv::runner::JointReducer proto;
+            if (fixed) proto = gdiv::runner::JointReducer(std::vector<double>(classes_a, classes_a + n_a),
+                                                         std::vector<double>(classes_b, classes_b + n_b));
+            gdiv::runner::JointReducer joint;
+            {
+                ThreadErrorThrow errors;
+                joint = gdiv::runner::reduce_pair(path_a, path_b,
+                                                  hasA ? std::optional<double>(ndA) : std::nullopt,
+                                                  hasB ? std::optional<double>(ndB) : std::nullopt,
+                                                  ro, proto);
+            }
+            if (out_valid) *out_valid = joint.valid;
+            if (table) std::copy(joint.counts.begin(), joint.counts.end(), table);
+            if (joint.total == 0) return 3;
+            gdiv::runner::TraceSpan span("finalize");
+            joint.finalize(out);
+            return 0;
+        } catch (...) {
+            return 9;
+        }
+    }
+
+    // --- Dataset cache ---
+    GDIV_API void gdiv_set_dataset_cache(int max_open_per_thread)
+    {
+        gdiv::runner::set_dataset_pool_capacity(max_open_per_thread > 0 ? (size_t)max_open_per_thread : 0);
+        if (max_open_per_thread <= 0) {
+            try { gdiv::runner::close_pooled_datasets(); } catch (...) {}
+        }
+    }
+
+    GDIV_API void gdiv_close_datasets(void)
+    {
+        try { gdiv::runner::close_pooled_datasets(); } catch (...) {}
+    }
+
+    GDIV_API void gdiv_set_mapped_reads(int on)
+    {
+        gdiv::runner::set_mapped_reads(on != 0);
+    }
+
+    // --- Result cache ---
+    GDIV_API int gdiv_set_result_cache(const char* dir, uint64_t max_bytes)
+    {
+        try {
+            gdiv::runner::set_result_cache(dir ? dir : "", max_bytes);
+            return (dir && *dir && !gdiv::runner::result_cache_enabled()) ? 1 : 0;
+        } catch (...) {
+            return 9;
+        }
+    }
+
+    GDIV_API void gdiv_clear_result_cache(void)
+    {
+        try { gdiv::runner::clear_result_cache(); } catch (...) {}
+    }
+
+    // --- Stats ---
+    GDIV_API void gdiv_set_stats(GdivStats* stats)
+    {
+        t_stats = stats;
+    }
+
+    // --- Trace ---
+    GDIV_API void gdiv_start_trace(int events_per_thread)
+    {
+        if (events_per_thread > 0) gdiv::runner::start_trace((size_t)events_per_thread);
+        else gdiv::runner::start_trace();
+    }
+
+    GDIV_API int gdiv_stop_trace(const char* json_path)
+    {
+        gdiv::runner::stop_trace();
+        if (!json_path || !*json_path) return 100;
+        try {
+            return gdiv::runner::write_trace(json_path) ? 0 : 4;
+        } catch (...) {
+            return 9;
+        }
+    }
+
+    // --- Memory budget ---
+    GDIV_API void gdiv_set_memory_budget(uint64_t bytes)
+    {
+        gdal_init_once();
+        gdiv::runner::set_memory_budget(bytes);
+    }
+
 } // extern "C"
 
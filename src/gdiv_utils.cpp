@@ -1,7 +1,12 @@
 #include "gdiv_utils.h"
+#include "gdiv/runner/memory_budget.h"
+#include "gdiv/runner/stats.h"
+#include "gdiv/runner/trace.h"
 #include <algorithm>
 #include <limits>
 #include <mutex>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 
 // Initialization
@@ -27,9 +32,13 @@ bool prefer_full_read(GDALRasterBand* band, const RasterOptions* opt, size_t ele
     const unsigned long long need =
         (unsigned long long)w * (unsigned long long)h * (unsigned long long)elem_size;
 
-    const unsigned long long limit =
-        (opt && opt->max_bytes_simple) ? opt->max_bytes_simple
-                                       : (unsigned long long)256 * 1024 * 1024; // 256MB
+    unsigned long long limit = (unsigned long long)256 * 1024 * 1024; // 256MB
+    if (opt && opt->max_bytes_simple) {
+        limit = opt->max_bytes_simple;
+    } else if (const uint64_t share = gdiv::runner::memory_shares().buffers) {
+        // under a budget: this thread's part of the buffer share
+        limit = share / std::max(1u, std::thread::hardware_concurrency());
+    }
     return need <= limit;
 }
 
@@ -45,59 +54,160 @@ void compute_steps(GDALRasterBand* band, const RasterOptions* opt,
     stepY = use_tiles ? tileH : (opt && opt->win_size>0 ? opt->win_size : 512);
 }
 
-// Loop through pixels (double)
-int for_each_pixel_double(const char* path, const RasterOptions* opt,
-                          const std::function<void(double)>& pixel_fn,
-                          bool require_non_empty) {
+// Band 1 window as double; mapped files skip RasterIO. false on read errors
+static bool read_band1(GDALDataset* ds, int x, int y, int w, int h, double* out) {
+    try {
+        gdiv::runner::read_window(ds, {x, y, w, h}, out, 1, 1);
+        return true;
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+}
+
+// Hand one window to the caller's loop, counted as compute
+static void feed(const BlockFn& block_fn, const gdiv::runner::Block& blk) {
+    using namespace gdiv::runner;
+    stats_add(Counter::Pixels, blk.pixels());
+    StageTimer timer(Stage::Compute);
+    TraceSpan span("reduce");
+    block_fn(blk);
+}
+
+// Loop through windows (double)
+int for_each_block_double(const char* path, const RasterOptions* opt, const BlockFn& block_fn) {
     if (!path) return 100;
 
     gdiv_init_gdal_once();
-    GDALDataset* ds = static_cast<GDALDataset*>(GDALOpen(path, GA_ReadOnly));
+    // pooled: repeated calls on the same file skip the open
+    gdiv::runner::SharedDataset ds = gdiv::runner::thread_dataset_pool().acquire(path);
     if (!ds) return 1;
     GDALRasterBand* band = ds->GetRasterBand(1);
-    if (!band) { GDALClose(ds); return 1; }
+    if (!band) return 1;
 
     const int W = band->GetXSize(), H = band->GetYSize();
 
     bool hasND=false; double nd=std::numeric_limits<double>::quiet_NaN();
     resolve_nodata(band, opt, hasND, nd);
 
-    uint64_t seen = 0;
+    gdiv::runner::Block blk;
+    if (hasND) blk.nodata = nd;
 
     if (prefer_full_read(band, opt, sizeof(double))) {
-        std::vector<double> data((size_t)W * H);
-        if (band->RasterIO(GF_Read, 0,0, W,H, data.data(), W,H, GDT_Float64, 0,0) != CE_None) {
-            GDALClose(ds); return 2;
-        }
-        for (double v : data) {
-            if (is_invalid(v, hasND, nd)) continue;
-            pixel_fn(v);
-            ++seen;
-        }
+        // one-off buffer, not kept in the thread arena (can be up to max_bytes_simple)
+        gdiv::runner::ScratchBuffer<double> data;
+        data.reserve((size_t)W * H);
+        gdiv::runner::BufferUse held((uint64_t)W * H * sizeof(double));
+        if (!read_band1(ds.get(), 0,0, W,H, data.data())) return 2;
+        blk.data = data.data();
+        blk.win = {0, 0, W, H};
+        feed(block_fn, blk);
     } else {
         int stepX, stepY;
         compute_steps(band, opt, stepX, stepY);
 
-        std::vector<double> block;
+        // sized once for the largest window, reused by later calls on this thread
+        auto& block = gdiv::runner::thread_arena().tile;
+        block.reserve((size_t)std::min(stepX, W) * std::min(stepY, H));
+        gdiv::runner::BufferUse held(block.size() * sizeof(double));
         for (int y=0; y<H; y+=stepY) {
             const int hh = std::min(stepY, H - y);
             for (int x=0; x<W; x+=stepX) {
                 const int ww = std::min(stepX, W - x);
-                block.resize((size_t)ww * hh);
-                if (band->RasterIO(GF_Read, x,y, ww,hh, block.data(), ww,hh,
-                                   GDT_Float64, 0,0) != CE_None) {
-                    GDALClose(ds); return 2;
-                }
-                for (double v : block) {
-                    if (is_invalid(v, hasND, nd)) continue;
-                    pixel_fn(v);
-                    ++seen;
-                }
+                if (!read_band1(ds.get(), x,y, ww,hh, block.data())) return 2;
+                blk.data = block.data();
+                blk.win = {x, y, ww, hh};
+                feed(block_fn, blk);
             }
         }
     }
 
-    GDALClose(ds);
+    return 0;
+}
+
+static GDALDataType buffer_type(int dtype) {
+    switch (dtype) {
+        case GDIV_DT_UINT8:   return GDT_Byte;
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 7, 0)
+        case GDIV_DT_INT8:    return GDT_Int8;
+#endif
+        case GDIV_DT_UINT16:  return GDT_UInt16;
+        case GDIV_DT_INT16:   return GDT_Int16;
+        case GDIV_DT_UINT32:  return GDT_UInt32;
+        case GDIV_DT_INT32:   return GDT_Int32;
+        case GDIV_DT_FLOAT32: return GDT_Float32;
+        case GDIV_DT_FLOAT64: return GDT_Float64;
+        default:              return GDT_Unknown;
+    }
+}
+
+// Loop through windows of a caller buffer (double)
+int for_each_block_buffer(const RasterBuffer* buf, const RasterOptions* opt, const BlockFn& block_fn) {
+    if (!buf || !buf->data || buf->width <= 0 || buf->height <= 0) return 100;
+    const GDALDataType dt = buffer_type(buf->dtype);
+    if (dt == GDT_Unknown) return 100;
+
+    const int W = buf->width, H = buf->height;
+    const int elem = GDALGetDataTypeSizeBytes(dt);
+    const int64_t row_bytes = (int64_t)W * elem;
+    const int64_t stride = buf->stride ? buf->stride : row_bytes;
+    if (stride < row_bytes && -stride < row_bytes) return 100;   // rows overlap
+    const char* base = static_cast<const char*>(buf->data);
+
+    gdiv::runner::Block blk;
+    if (opt && opt->has_nodata) blk.nodata = opt->nodata;
+    else if (buf->has_nodata) blk.nodata = buf->nodata;
+
+    if (dt == GDT_Float64) {
+        // zero-copy: the reducers read caller memory directly
+        if (stride == row_bytes) {
+            blk.data = reinterpret_cast<const double*>(base);
+            blk.win = {0, 0, W, H};
+            feed(block_fn, blk);
+            return 0;
+        }
+        for (int y = 0; y < H; ++y) {
+            blk.data = reinterpret_cast<const double*>(base + (int64_t)y * stride);
+            blk.win = {0, y, W, 1};
+            feed(block_fn, blk);
+        }
+        return 0;
+    }
+
+    // convert a band of rows at a time into the thread arena
+    const int rows = std::max(1, std::min(H, (1 << 20) / W));
+    auto& block = gdiv::runner::thread_arena().tile;
+    block.reserve((size_t)W * rows);
+    gdiv::runner::BufferUse held(block.size() * sizeof(double));
+    for (int y = 0; y < H; y += rows) {
+        const int hh = std::min(rows, H - y);
+        {
+            gdiv::runner::StageTimer timer(gdiv::runner::Stage::Convert);
+            for (int r = 0; r < hh; ++r)
+                GDALCopyWords64(base + (int64_t)(y + r) * stride, dt, elem,
+                                block.data() + (size_t)r * W, GDT_Float64, sizeof(double), W);
+        }
+        blk.data = block.data();
+        blk.win = {0, y, W, hh};
+        feed(block_fn, blk);
+    }
+    return 0;
+}
+
+// Loop through pixels (double)
+int for_each_pixel_double(const char* path, const RasterOptions* opt,
+                          const std::function<void(double)>& pixel_fn,
+                          bool require_non_empty) {
+    uint64_t seen = 0;
+    int rc = for_each_block_double(path, opt, [&](const gdiv::runner::Block& blk) {
+        const size_t n = blk.pixels();
+        for (size_t i = 0; i < n; ++i) {
+            const double v = blk.data[i];
+            if (gdiv::runner::skip_value(v, blk.nodata)) continue;
+            pixel_fn(v);
+            ++seen;
+        }
+    });
+    if (rc) return rc;
     if (require_non_empty && seen==0) return 3;
     return 0;
 }
@@ -109,10 +219,11 @@ int for_each_pixel_int(const char* path, const RasterOptions* opt,
     if (!path) return 100;
 
     gdiv_init_gdal_once();
-    GDALDataset* ds = static_cast<GDALDataset*>(GDALOpen(path, GA_ReadOnly));
+    // pooled: repeated calls on the same file skip the open
+    gdiv::runner::SharedDataset ds = gdiv::runner::thread_dataset_pool().acquire(path);
     if (!ds) return 1;
     GDALRasterBand* band = ds->GetRasterBand(1);
-    if (!band) { GDALClose(ds); return 1; }
+    if (!band) return 1;
 
     const int W = band->GetXSize(), H = band->GetYSize();
 
@@ -122,11 +233,13 @@ int for_each_pixel_int(const char* path, const RasterOptions* opt,
     uint64_t seen = 0;
 
     if (prefer_full_read(band, opt, sizeof(int))) {
-        std::vector<int> data((size_t)W * H);
+        gdiv::runner::ScratchBuffer<int> data;
+        data.reserve((size_t)W * H);
         if (band->RasterIO(GF_Read, 0,0, W,H, data.data(), W,H, GDT_Int32, 0,0) != CE_None) {
-            GDALClose(ds); return 2;
+            return 2;
         }
-        for (int vi : data) {
+        for (size_t i = 0; i < data.size(); ++i) {
+            const int vi = data.data()[i];
             // 与 NoData 的比较：转 double 再走统一逻辑
             const double v = static_cast<double>(vi);
             if (is_invalid(v, hasND, nd)) continue;
@@ -137,17 +250,19 @@ int for_each_pixel_int(const char* path, const RasterOptions* opt,
         int stepX, stepY;
         compute_steps(band, opt, stepX, stepY);
 
-        std::vector<int> block;
+        auto& block = gdiv::runner::thread_arena().tile_int;
+        block.reserve((size_t)std::min(stepX, W) * std::min(stepY, H));
         for (int y=0; y<H; y+=stepY) {
             const int hh = std::min(stepY, H - y);
             for (int x=0; x<W; x+=stepX) {
                 const int ww = std::min(stepX, W - x);
-                block.resize((size_t)ww * hh);
+                const size_t n = (size_t)ww * hh;
                 if (band->RasterIO(GF_Read, x,y, ww,hh, block.data(), ww,hh,
                                    GDT_Int32, 0,0) != CE_None) {
-                    GDALClose(ds); return 2;
+                    return 2;
                 }
-                for (int vi : block) {
+                for (size_t i = 0; i < n; ++i) {
+                    const int vi = block.data()[i];
                     const double v = static_cast<double>(vi);
                     if (is_invalid(v, hasND, nd)) continue;
                     pixel_fn(vi);
@@ -157,7 +272,6 @@ int for_each_pixel_int(const char* path, const RasterOptions* opt,
         }
     }
 
-    GDALClose(ds);
     if (require_non_empty && seen==0) return 3;
     return 0;
 }
\ No newline at end of file
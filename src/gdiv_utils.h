@@ -1,5 +1,7 @@
 #pragma once
 #include "gdiv_toolbox.h"
+#include "gdiv/runner/reducer.h"
+#include "gdiv/runner/buffer.h"
 #include <gdal_priv.h>
 #include <cstdint>
 #include <functional>
@@ -30,6 +32,16 @@ void compute_steps(GDALRasterBand* band, const RasterOptions* opt,
 // Return：0=OK, 1=unable to open, or no band  2 = block read failed
 // 3 = no valid pixel -- only when require_non_empty=true
 
+using BlockFn = std::function<void(const gdiv::runner::Block&)>;
+
+// Loop through windows of band 1 read as double; NODATA is resolved into Block::nodata
+// Return: 0=OK, 1=unable to open, or no band  2 = block read failed
+int for_each_block_double(const char* path, const RasterOptions* opt, const BlockFn& block_fn);
+
+// Same over a caller buffer: Float64 rows are passed through in place, other types are
+// converted a few rows at a time. Return: 0=OK, 100=invalid buffer
+int for_each_block_buffer(const RasterBuffer* buf, const RasterOptions* opt, const BlockFn& block_fn);
+
 int for_each_pixel_double(const char* path, const RasterOptions* opt,
                           const std::function<void(double)>& pixel_fn,
                           bool require_non_empty = false);
@@ -1,32 +1,39 @@
 #include "gdiv_utils.h"
+#include "gdiv/runner/stats.h"
 
-int msr_compute(const char* path, const RasterOptions* opt,
-                double* mean, double* var, double* vmin, double* vmax, uint64_t* valid) {
-    long double sum = 0, sumsq = 0;
-    double mn = std::numeric_limits<double>::infinity();
-    double mx = -mn;
-    uint64_t n = 0;
+// Reduce whatever windows `source` produces
+static int msr_run(const std::function<int(const BlockFn&)>& source,
+                   double* mean, double* var, double* vmin, double* vmax, uint64_t* valid) {
+    gdiv::runner::MsrReducer msr;
 
-    // Loop through all raster pixels (helper from gdiv_utils)
-    int rc = for_each_pixel_double(path, opt, [&](double v){
-        sum += v;
-        sumsq += (long double)v * v;
-        ++n;
-        if (v < mn) mn = v;
-        if (v > mx) mx = v;
-    }, /*require_non_empty=*/true);
+    int rc = source([&](const gdiv::runner::Block& blk){
+        msr.accumulate(blk);
+    });
     if (rc) return rc;
+    gdiv::runner::stats_add(gdiv::runner::Counter::Valid, msr.n);
+    if (msr.n == 0) return 3;
 
-    *mean = (double)(sum / n);
-
-    // Variance = E[x^2] - (E[x])^2
-    long double variance = (sumsq / n) - ((long double)(*mean) * (*mean));
-    if (variance < 0) variance = 0;
+    double out[gdiv::runner::MsrReducer::metrics];
+    msr.finalize(out);
 
-    *var = (double)variance;
-    *vmin = mn;
-    *vmax = mx;
-    *valid = n;
+    *mean = out[0];
+    *var = out[1];
+    *vmin = out[2];
+    *vmax = out[3];
+    *valid = msr.n;
 
     return 0;
 }
+
+int msr_compute(const char* path, const RasterOptions* opt,
+                double* mean, double* var, double* vmin, double* vmax, uint64_t* valid) {
+    // Loop through all raster windows (helper from gdiv_utils)
+    return msr_run([&](const BlockFn& fn){ return for_each_block_double(path, opt, fn); },
+                   mean, var, vmin, vmax, valid);
+}
+
+int msr_compute_buffer(const RasterBuffer* buf, const RasterOptions* opt,
+                       double* mean, double* var, double* vmin, double* vmax, uint64_t* valid) {
+    return msr_run([&](const BlockFn& fn){ return for_each_block_buffer(buf, opt, fn); },
+                   mean, var, vmin, vmax, valid);
+}
@@ -0,0 +1,10 @@
+#include "gdiv/runner/buffer.h"
+
+namespace gdiv::runner {
+
+BufferArena& thread_arena() {
+    thread_local BufferArena arena;
+    return arena;
+}
+
+} // namespace gdiv::runner
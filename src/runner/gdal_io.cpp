@@ -1,6 +1,29 @@
 #include "gdiv/runner/gdal_io.h"
+#include "gdiv/runner/stats.h"
+#include "gdiv/runner/trace.h"
 #include <stdexcept>
 #include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <cpl_vsi.h>
+#include <vector>
+#if defined(_WIN32) || defined(_WIN64)
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
 
 namespace gdiv::runner {
 
@@ -8,14 +31,391 @@ static std::once_flag gdal_once;
 
 GDALDatasetPtr open_readonly(const std::string& path) {
     std::call_once(gdal_once, [] { GDALAllRegister(); });
-    GDALDataset* raw = static_cast<GDALDataset*>(
-        GDALOpen(path.c_str(), GA_ReadOnly));
+    GDALDataset* raw = nullptr;
+    {
+        StageTimer timer(Stage::Open);
+        TraceSpan span("open");
+        raw = static_cast<GDALDataset*>(GDALOpen(path.c_str(), GA_ReadOnly));
+    }
     if (!raw) {
         throw std::runtime_error("GDALOpen failed: " + path);
     }
+    stats_add(Counter::Opened, 1);
     return GDALDatasetPtr(raw, [](GDALDataset* ds){ GDALClose(ds); });
 }
 
+// ---------------------------
+// Memory-mapped rasters
+// ---------------------------
+static std::atomic<bool> g_mapped_reads{false};
+
+void set_mapped_reads(bool on) { g_mapped_reads = on; }
+
+bool mapped_reads() { return g_mapped_reads; }
+
+namespace {
+
+    // Whole file mapped read-only; empty when the file cannot be mapped
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string& path);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const unsigned char* data() const { return data_; }
+        uint64_t size() const { return size_; }
+
+    private:
+        const unsigned char* data_ = nullptr;
+        uint64_t size_ = 0;
+#if defined(_WIN32) || defined(_WIN64)
+        HANDLE file_ = INVALID_HANDLE_VALUE;
+        HANDLE mapping_ = nullptr;
+#endif
+    };
+
+#if defined(_WIN32) || defined(_WIN64)
+    MappedFile::MappedFile(const std::string& path) {
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER sz;
+        if (!GetFileSizeEx(file_, &sz) || sz.QuadPart <= 0) return;
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_) return;
+        data_ = static_cast<const unsigned char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        if (data_) size_ = static_cast<uint64_t>(sz.QuadPart);
+    }
+
+    MappedFile::~MappedFile() {
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+    }
+#else
+    MappedFile::MappedFile(const std::string& path) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) {
+                data_ = static_cast<const unsigned char*>(p);
+                size_ = static_cast<uint64_t>(st.st_size);
+            }
+        }
+        ::close(fd);   // the mapping stays valid
+    }
+
+    MappedFile::~MappedFile() {
+        if (data_) ::munmap(const_cast<unsigned char*>(data_), static_cast<size_t>(size_));
+    }
+#endif
+
+} // namespace
+
+/** Pixel data of a raw-stored raster located inside a mapped file: a grid of
+ *  blocks (one block for raw formats, tiles or strips for GeoTIFF), each band
+ *  with its own block offsets and the same strides.
+ */
+class MappedRaster {
+public:
+    static std::unique_ptr<MappedRaster> create(GDALDataset* ds);
+
+    /** read_window() into doubles; false if the window is outside the raster. */
+    bool read(const Window& win, double* out, int first_band, int band_count, Layout layout) const;
+
+private:
+    bool map(const std::string& path);
+    bool from_tiff(GDALDataset* ds);
+    bool from_raw_layout(GDALDataset* ds);
+    bool in_file() const;
+
+    std::unique_ptr<MappedFile> file_;
+    GDALDataType type_ = GDT_Unknown;
+    int elem_ = 0;
+    int width_ = 0, height_ = 0;
+    int block_w_ = 0, block_h_ = 0, blocks_x_ = 0, blocks_y_ = 0;
+    int64_t pixel_stride_ = 0, line_stride_ = 0;   // bytes, inside a block
+    std::vector<std::vector<uint64_t>> offsets_;  // [band][block row-major]
+};
+
+static bool raw_type(GDALDataType t) {
+    switch (t) {
+        case GDT_Byte: case GDT_UInt16: case GDT_Int16:
+        case GDT_UInt32: case GDT_Int32:
+        case GDT_Float32: case GDT_Float64:
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 5, 0)
+        case GDT_UInt64: case GDT_Int64:
+#endif
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 7, 0)
+        case GDT_Int8:
+#endif
+            return true;
+        default:
+            return false;   // complex and unknown types go through GDAL
+    }
+}
+
+bool MappedRaster::map(const std::string& path) {
+    file_ = std::make_unique<MappedFile>(path);
+    return file_->data() != nullptr;
+}
+
+// Uncompressed GeoTIFF: tile / strip offsets from the TIFF metadata domain
+bool MappedRaster::from_tiff(GDALDataset* ds) {
+    const char* comp = ds->GetMetadataItem("COMPRESSION", "IMAGE_STRUCTURE");
+    if (comp && *comp && !EQUAL(comp, "NONE")) return false;
+
+    GDALRasterBand* b1 = ds->GetRasterBand(1);
+    const char* nbits = b1->GetMetadataItem("NBITS", "IMAGE_STRUCTURE");
+    if (nbits && std::atoi(nbits) != elem_ * 8) return false;   // packed sub-byte samples
+
+    const char* il = ds->GetMetadataItem("INTERLEAVE", "IMAGE_STRUCTURE");
+    const bool pixel_il = il && EQUAL(il, "PIXEL") && ds->GetRasterCount() > 1;
+
+    b1->GetBlockSize(&block_w_, &block_h_);
+    if (block_w_ <= 0 || block_h_ <= 0) return false;
+    if (!map(ds->GetDescription())) return false;
+
+    // "II" little endian, "MM" big endian
+    if (file_->size() < 8) return false;
+    const bool le = file_->data()[0] == 'I' && file_->data()[1] == 'I';
+    const bool be = file_->data()[0] == 'M' && file_->data()[1] == 'M';
+    if (!(CPL_IS_LSB ? le : be) && elem_ > 1) return false;
+
+    const int bands = ds->GetRasterCount();
+    pixel_stride_ = pixel_il ? static_cast<int64_t>(elem_) * bands : elem_;
+    line_stride_ = pixel_stride_ * block_w_;
+    blocks_x_ = (width_ + block_w_ - 1) / block_w_;
+    blocks_y_ = (height_ + block_h_ - 1) / block_h_;
+
+    offsets_.assign(bands, std::vector<uint64_t>(static_cast<size_t>(blocks_x_) * blocks_y_));
+    char key[64];
+    for (int b = 0; b < bands; ++b) {
+        // pixel interleaved: one block holds every band, band b starts b samples in
+        GDALRasterBand* src = ds->GetRasterBand(pixel_il ? 1 : b + 1);
+        for (int by = 0; by < blocks_y_; ++by) {
+            for (int bx = 0; bx < blocks_x_; ++bx) {
+                uint64_t off = 0;
+                if (pixel_il && b > 0) {
+                    off = offsets_[0][static_cast<size_t>(by) * blocks_x_ + bx] + static_cast<uint64_t>(b) * elem_;
+                } else {
+                    std::snprintf(key, sizeof(key), "BLOCK_OFFSET_%d_%d", bx, by);
+                    const char* v = src->GetMetadataItem(key, "TIFF");
+                    off = v ? std::strtoull(v, nullptr, 10) : 0;
+                    if (off == 0) return false;   // sparse block, GDAL fills it
+                }
+                offsets_[b][static_cast<size_t>(by) * blocks_x_ + bx] = off;
+            }
+        }
+    }
+    return true;
+}
+
+// ENVI, EHdr, BIL, ...: one block described by GDAL (3.1+)
+bool MappedRaster::from_raw_layout(GDALDataset* ds) {
+#if GDAL_VERSION_NUM < GDAL_COMPUTE_VERSION(3, 1, 0)
+    (void)ds;
+    return false;
+#else
+    GDALDataset::RawBinaryLayout rl;
+    if (!ds->GetRawBinaryLayout(rl)) return false;
+    if (rl.eDataType != type_) return false;
+    if (elem_ > 1 && rl.bLittleEndianOrder != static_cast<bool>(CPL_IS_LSB)) return false;
+    if (rl.nPixelOffset <= 0 || rl.nLineOffset <= 0 || rl.nBandOffset < 0) return false;   // bottom-up layouts
+    if (!map(rl.osRawFilename)) return false;
+
+    block_w_ = width_;
+    block_h_ = height_;
+    blocks_x_ = blocks_y_ = 1;
+    pixel_stride_ = rl.nPixelOffset;
+    line_stride_ = rl.nLineOffset;
+    offsets_.assign(ds->GetRasterCount(), std::vector<uint64_t>(1));
+    for (size_t b = 0; b < offsets_.size(); ++b)
+        offsets_[b][0] = static_cast<uint64_t>(rl.nImageOffset) + b * static_cast<uint64_t>(rl.nBandOffset);
+    return true;
+#endif
+}
+
+// every block lies inside the mapped file (a truncated file would fault on read)
+bool MappedRaster::in_file() const {
+    for (int by = 0; by < blocks_y_; ++by) {
+        const int rows = std::min(block_h_, height_ - by * block_h_);
+        for (int bx = 0; bx < blocks_x_; ++bx) {
+            const int cols = std::min(block_w_, width_ - bx * block_w_);
+            const uint64_t span = static_cast<uint64_t>(rows - 1) * line_stride_
+                                + static_cast<uint64_t>(cols - 1) * pixel_stride_ + elem_;
+            for (const auto& band : offsets_) {
+                const uint64_t off = band[static_cast<size_t>(by) * blocks_x_ + bx];
+                if (off > file_->size() || span > file_->size() - off) return false;
+            }
+        }
+    }
+    return true;
+}
+
+std::unique_ptr<MappedRaster> MappedRaster::create(GDALDataset* ds) {
+    if (!ds || ds->GetRasterCount() < 1) return nullptr;
+    auto m = std::unique_ptr<MappedRaster>(new MappedRaster());
+    m->width_ = ds->GetRasterXSize();
+    m->height_ = ds->GetRasterYSize();
+    m->type_ = ds->GetRasterBand(1)->GetRasterDataType();
+    if (!raw_type(m->type_) || m->width_ <= 0 || m->height_ <= 0) return nullptr;
+    for (int b = 2; b <= ds->GetRasterCount(); ++b)
+        if (ds->GetRasterBand(b)->GetRasterDataType() != m->type_) return nullptr;
+    m->elem_ = GDALGetDataTypeSizeBytes(m->type_);
+
+    GDALDriver* drv = ds->GetDriver();
+    const bool tiff = drv && drv->GetDescription() && EQUAL(drv->GetDescription(), "GTiff");
+    const bool ok = tiff ? m->from_tiff(ds) : m->from_raw_layout(ds);
+    if (!ok || !m->in_file()) return nullptr;
+    return m;
+}
+
+bool MappedRaster::read(const Window& win, double* out, int first_band, int band_count, Layout layout) const {
+    if (win.x < 0 || win.y < 0 || win.w <= 0 || win.h <= 0
+        || win.x + win.w > width_ || win.y + win.h > height_) return false;
+
+    const bool pi = (layout == Layout::PixelInterleaved);
+    const size_t step = pi ? static_cast<size_t>(band_count) : 1;   // doubles between pixels
+    const int dst_space = static_cast<int>(step * sizeof(double));
+    const unsigned char* base = file_->data();
+
+    for (int k = 0; k < band_count; ++k) {
+        const std::vector<uint64_t>& offs = offsets_[first_band - 1 + k];
+        double* plane = pi ? out + k : out + static_cast<size_t>(k) * win.w * win.h;
+        for (int r = 0; r < win.h; ++r) {
+            const int y = win.y + r;
+            const int by = y / block_h_;
+            const int64_t row_off = static_cast<int64_t>(y - by * block_h_) * line_stride_;
+            double* dst = plane + static_cast<size_t>(r) * win.w * step;
+            // one run per block the row crosses
+            for (int x = win.x; x < win.x + win.w;) {
+                const int bx = x / block_w_;
+                const int xx = x - bx * block_w_;
+                const int n = std::min(block_w_ - xx, win.x + win.w - x);
+                const unsigned char* src = base + offs[static_cast<size_t>(by) * blocks_x_ + bx]
+                                         + row_off + static_cast<int64_t>(xx) * pixel_stride_;
+                GDALCopyWords64(src, type_, static_cast<int>(pixel_stride_), dst, GDT_Float64, dst_space, n);
+                dst += static_cast<size_t>(n) * step;
+                x += n;
+            }
+        }
+    }
+    return true;
+}
+
+// ---------------------------
+// Dataset pool
+// ---------------------------
+static std::atomic<size_t> g_pool_capacity{0};
+
+struct DatasetPool::Entry {
+    std::string path;
+    SharedDataset ds;
+    long long size = 0;
+    long long mtime = 0;        // file clock ticks (ns on most platforms)
+    std::unique_ptr<MappedRaster> map;
+    bool map_tried = false;
+};
+
+// size + mtime of a file: full clock resolution for local files, whole seconds
+// through VSIStatL for GDAL virtual paths. false when neither can stat it
+static bool file_stamp(const std::string& path, long long& size, long long& mtime) {
+    std::error_code ec;
+    const auto sz = fs::file_size(path, ec);
+    const auto t = ec ? fs::file_time_type() : fs::last_write_time(path, ec);
+    if (!ec) {
+        size = static_cast<long long>(sz);
+        mtime = static_cast<long long>(t.time_since_epoch().count());
+        return true;
+    }
+    VSIStatBufL st;
+    if (VSIStatL(path.c_str(), &st) != 0) return false;
+    size = static_cast<long long>(st.st_size);
+    mtime = static_cast<long long>(st.st_mtime);
+    return true;
+}
+
+SharedDataset DatasetPool::acquire(const std::string& path) {
+    std::call_once(gdal_once, [] { GDALAllRegister(); });
+    const size_t cap = g_pool_capacity.load(std::memory_order_relaxed);
+
+    long long size = 0, mtime = 0;
+    const bool stamped = file_stamp(path, size, mtime);
+
+    auto it = index_.find(path);
+    if (it != index_.end()) {
+        if (stamped && it->second->size == size && it->second->mtime == mtime) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return lru_.front().ds;
+        }
+        lru_.erase(it->second);   // file changed on disk
+        index_.erase(it);
+    }
+
+    GDALDataset* raw = nullptr;
+    {
+        StageTimer timer(Stage::Open);
+        TraceSpan span("open");
+        raw = static_cast<GDALDataset*>(GDALOpen(path.c_str(), GA_ReadOnly));
+    }
+    if (!raw) return nullptr;
+    stats_add(Counter::Opened, 1);
+    SharedDataset ds(raw, [](GDALDataset* d){ GDALClose(d); });
+    if (cap == 0 || !stamped) return ds;   // a change could not be detected: not kept
+
+    lru_.emplace_front();
+    Entry& e = lru_.front();
+    e.path = path;
+    e.ds = ds;
+    e.size = size;
+    e.mtime = mtime;
+    index_[path] = lru_.begin();
+    while (lru_.size() > cap) {
+        index_.erase(lru_.back().path);
+        lru_.pop_back();   // borrowers keep their reference alive
+    }
+    return ds;
+}
+
+const MappedRaster* DatasetPool::mapped(GDALDataset* ds) {
+    if (!g_mapped_reads.load(std::memory_order_relaxed)) return nullptr;
+    for (Entry& e : lru_) {
+        if (e.ds.get() != ds) continue;
+        if (!e.map_tried) {
+            e.map_tried = true;
+            e.map = MappedRaster::create(ds);
+        }
+        return e.map.get();
+    }
+    return nullptr;
+}
+
+void DatasetPool::clear() {
+    index_.clear();
+    lru_.clear();
+}
+
+size_t DatasetPool::size() const { return lru_.size(); }
+
+DatasetPool& thread_dataset_pool() {
+    thread_local DatasetPool pool;
+    return pool;
+}
+
+void set_dataset_pool_capacity(size_t n) { g_pool_capacity = n; }
+
+size_t dataset_pool_capacity() { return g_pool_capacity; }
+
+SharedDataset open_pooled(const std::string& path) {
+    SharedDataset ds = thread_dataset_pool().acquire(path);
+    if (!ds) throw std::runtime_error("GDALOpen failed: " + path);
+    return ds;
+}
+
 DatasetInfo describe(GDALDataset* ds) {
     if (!ds) throw std::runtime_error("describe(): null dataset");
     DatasetInfo info;
@@ -28,37 +428,87 @@ DatasetInfo describe(GDALDataset* ds) {
         int success = 0;
         const double nd = ds->GetRasterBand(1)->GetNoDataValue(&success);
         if (success) info.nodata = nd;
+        ds->GetRasterBand(1)->GetBlockSize(&info.block_w, &info.block_h);
     }
+
+    const char* comp = ds->GetMetadataItem("COMPRESSION", "IMAGE_STRUCTURE");
+    if (comp) info.compression = comp;
     return info;
 }
 
-void read_window(GDALDataset* ds, const Window& win, std::vector<double>& out,
-                 int first_band, int band_count)
-{
+static int checked_band_count(GDALDataset* ds, int first_band, int band_count) {
     if (!ds) throw std::runtime_error("read_window(): null dataset");
     const int bands_total = ds->GetRasterCount();
     if (band_count == 0) band_count = bands_total;
     if (first_band < 1 || first_band > bands_total)
         throw std::runtime_error("Invalid first_band");
+    if (band_count < 1 || first_band + band_count - 1 > bands_total)
+        throw std::runtime_error("Invalid band_count");
+    return band_count;
+}
 
-    out.assign(static_cast<size_t>(win.w) * win.h * band_count, 0.0);
-
-    // read through bands
-    for (int b = 0; b < band_count; ++b) {
-        GDALRasterBand* band = ds->GetRasterBand(first_band + b);
-        const CPLErr err = band->RasterIO(
-            GF_Read,
-            win.x, win.y, win.w, win.h,
-            out.data() + static_cast<size_t>(b) * win.w * win.h,
-            win.w, win.h, GDT_Float64,
-            0, 0, // default - continuous.
-            nullptr
-        );
-        if (err != CE_None) {
-            throw std::runtime_error("RasterIO failed at window("
-                                     + std::to_string(win.x) + "," + std::to_string(win.y)
-                                     + "," + std::to_string(win.w) + "x" + std::to_string(win.h) + ")");
-        }
+// bytes (file data type) and blocks of the first band's grid a window read touches
+static void count_read(GDALDataset* ds, const Window& win, int first_band, int band_count) {
+    GDALRasterBand* band = ds->GetRasterBand(first_band);
+    int bw = 0, bh = 0;
+    band->GetBlockSize(&bw, &bh);
+    if (bw <= 0 || bh <= 0 || win.w <= 0 || win.h <= 0) return;
+    const uint64_t blocks = static_cast<uint64_t>((win.x + win.w - 1) / bw - win.x / bw + 1)
+                          * static_cast<uint64_t>((win.y + win.h - 1) / bh - win.y / bh + 1);
+    stats_add(Counter::BlocksRead, blocks * band_count);
+    stats_add(Counter::BytesRead, static_cast<uint64_t>(win.w) * win.h * band_count
+                                  * GDALGetDataTypeSizeBytes(band->GetRasterDataType()));
+}
+
+void read_window(GDALDataset* ds, const Window& win, ScratchBuffer<double>& out,
+                 int first_band, int band_count, Layout layout)
+{
+    band_count = checked_band_count(ds, first_band, band_count);
+    out.reserve(static_cast<size_t>(win.w) * win.h * band_count);
+    read_window(ds, win, out.data(), first_band, band_count, layout);
+}
+
+void read_window(GDALDataset* ds, const Window& win, double* out,
+                 int first_band, int band_count, Layout layout)
+{
+    band_count = checked_band_count(ds, first_band, band_count);
+    if (current_stats()) count_read(ds, win, first_band, band_count);
+    TraceSpan span("read_window", "pixels", static_cast<int64_t>(win.w) * win.h * band_count);
+
+    if (const MappedRaster* m = thread_dataset_pool().mapped(ds)) {
+        StageTimer timer(Stage::Convert);   // no decode: a copy out of the mapping
+        if (m->read(win, out, first_band, band_count, layout)) return;
+    }
+
+    // band map on the stack for the usual band counts
+    int small_map[16];
+    std::vector<int> big_map;
+    int* band_map = small_map;
+    if (band_count > 16) { big_map.resize(band_count); band_map = big_map.data(); }
+    for (int b = 0; b < band_count; ++b) band_map[b] = first_band + b;
+
+    // spacing in bytes
+    const GSpacing px = sizeof(double);
+    const GSpacing pixel_space = (layout == Layout::PixelInterleaved) ? px * band_count : px;
+    const GSpacing line_space  = pixel_space * win.w;
+    const GSpacing band_space  = (layout == Layout::PixelInterleaved)
+                               ? px : px * win.w * win.h;
+
+    // read all bands at once
+    StageTimer timer(Stage::Read);
+    const CPLErr err = ds->RasterIO(
+        GF_Read,
+        win.x, win.y, win.w, win.h,
+        out,
+        win.w, win.h, GDT_Float64,
+        band_count, band_map,
+        pixel_space, line_space, band_space,
+        nullptr
+    );
+    if (err != CE_None) {
+        throw std::runtime_error("RasterIO failed at window("
+                                 + std::to_string(win.x) + "," + std::to_string(win.y)
+                                 + "," + std::to_string(win.w) + "x" + std::to_string(win.h) + ")");
     }
 }
 
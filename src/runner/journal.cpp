@@ -0,0 +1,172 @@
+#include "gdiv/runner/journal.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_set>
+#if defined(_WIN32) || defined(_WIN64)
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+#endif
+
+namespace gdiv::runner {
+
+static const char* const JOURNAL_MAGIC = "gdiv-journal 1\t";
+
+static uint32_t fnv1a(const char* s, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= static_cast<unsigned char>(s[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void replace_file(const std::string& from, const std::string& to) {
+#if defined(_WIN32) || defined(_WIN64)
+    const bool ok = MoveFileExA(from.c_str(), to.c_str(),
+                                MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    const bool ok = std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+    if (!ok) throw std::runtime_error("Journal: cannot replace " + to);
+}
+
+Journal::Journal(const std::string& path, const std::string& tag, int metrics)
+    : path_(path), tag_(tag), metrics_(metrics)
+{
+    bool dirty = false;
+    load(dirty);
+    if (dirty) {
+        // new file, or a torn / corrupt tail: keep the good records only
+        std::vector<const std::string*> order;
+        for (const auto& kv : entries_) order.push_back(&kv.first);
+        rewrite(order);
+    }
+    fp_ = std::fopen(path_.c_str(), "ab");
+    if (!fp_) throw std::runtime_error("Journal: cannot open " + path_);
+}
+
+Journal::~Journal() {
+    if (fp_) std::fclose(fp_);
+}
+
+void Journal::load(bool& dirty) {
+    std::FILE* f = std::fopen(path_.c_str(), "rb");
+    if (!f) { dirty = true; return; }
+    std::string text;
+    char chunk[1 << 16];
+    size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0) text.append(chunk, n);
+    std::fclose(f);
+
+    size_t pos = text.find('\n');
+    if (pos == std::string::npos) { dirty = true; return; }   // empty or torn header
+    const std::string header = text.substr(0, pos);
+    if (header != JOURNAL_MAGIC + tag_)
+        throw std::runtime_error("Journal: " + path_ + " was written by a different run");
+    ++pos;
+
+    while (pos < text.size()) {
+        const size_t eol = text.find('\n', pos);
+        if (eol == std::string::npos) { dirty = true; break; }   // torn last line
+        const char* line = text.c_str() + pos;
+        const size_t len = eol - pos;
+        pos = eol + 1;
+
+        // <crc>\t<body>
+        const char* tab = static_cast<const char*>(std::memchr(line, '\t', len));
+        if (!tab) { dirty = true; continue; }
+        const char* body = tab + 1;
+        const size_t body_len = len - static_cast<size_t>(body - line);
+        if (std::strtoul(line, nullptr, 16) != fnv1a(body, body_len)) { dirty = true; continue; }
+
+        // <bands>\t<values>\t<path>
+        const std::string rec(body, body_len);
+        const size_t t1 = rec.find('\t');
+        const size_t t2 = (t1 == std::string::npos) ? t1 : rec.find('\t', t1 + 1);
+        if (t2 == std::string::npos || t2 + 1 >= rec.size()) { dirty = true; continue; }
+
+        Entry e;
+        e.bands = std::atoi(rec.c_str());
+        const size_t count = static_cast<size_t>(e.bands) * metrics_;
+        const char* p = rec.c_str() + t1 + 1;
+        for (size_t i = 0; i < count; ++i) {
+            char* end = nullptr;
+            const double v = std::strtod(p, &end);
+            if (end == p) break;
+            e.values.push_back(v);
+            p = end;
+        }
+        if (e.bands <= 0 || e.values.size() != count) { dirty = true; continue; }
+        entries_[rec.substr(t2 + 1)] = std::move(e);   // later records win
+    }
+}
+
+std::string Journal::format(const std::string& raster, const Entry& e) const {
+    std::string body = std::to_string(e.bands) + "\t";
+    char num[32];
+    for (size_t i = 0; i < e.values.size(); ++i) {
+        std::snprintf(num, sizeof(num), i ? " %.17g" : "%.17g", e.values[i]);
+        body += num;
+    }
+    body += "\t" + raster;
+
+    char crc[16];
+    std::snprintf(crc, sizeof(crc), "%08x\t", static_cast<unsigned>(fnv1a(body.data(), body.size())));
+    return crc + body + "\n";
+}
+
+void Journal::rewrite(const std::vector<const std::string*>& order) {
+    const std::string tmp = path_ + ".tmp";
+    std::FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) throw std::runtime_error("Journal: cannot write " + tmp);
+
+    std::string text = JOURNAL_MAGIC + tag_ + "\n";
+    for (const std::string* r : order) text += format(*r, entries_.at(*r));
+    const bool ok = std::fwrite(text.data(), 1, text.size(), f) == text.size()
+                 && std::fflush(f) == 0;
+    std::fclose(f);
+    if (!ok) throw std::runtime_error("Journal: cannot write " + tmp);
+    replace_file(tmp, path_);
+}
+
+const Journal::Entry* Journal::find(const std::string& raster) const {
+    std::lock_guard<std::mutex> lk(m_);
+    auto it = entries_.find(raster);
+    return it == entries_.end() ? nullptr : &it->second;
+}
+
+void Journal::append(const std::string& raster, int bands, const double* values) {
+    if (raster.find_first_of("\t\n") != std::string::npos) return;   // not representable, recompute next time
+
+    Entry e;
+    e.bands = bands;
+    e.values.assign(values, values + static_cast<size_t>(bands) * metrics_);
+    const std::string line = format(raster, e);
+
+    std::lock_guard<std::mutex> lk(m_);
+    if (std::fputs(line.c_str(), fp_) < 0 || std::fflush(fp_) != 0)
+        throw std::runtime_error("Journal: write failed on " + path_);
+    entries_[raster] = std::move(e);
+}
+
+void Journal::compact(const std::vector<std::string>& rasters) {
+    std::lock_guard<std::mutex> lk(m_);
+    std::unordered_set<std::string> keep;
+    std::vector<const std::string*> order;
+    for (const std::string& r : rasters)
+        if (entries_.count(r) && keep.insert(r).second) order.push_back(&r);
+    for (auto it = entries_.begin(); it != entries_.end();)
+        it = keep.count(it->first) ? std::next(it) : entries_.erase(it);
+
+    std::fclose(fp_);
+    fp_ = nullptr;
+    rewrite(order);
+    fp_ = std::fopen(path_.c_str(), "ab");
+    if (!fp_) throw std::runtime_error("Journal: cannot open " + path_);
+}
+
+} // namespace gdiv::runner
@@ -0,0 +1,106 @@
+#include "gdiv/runner/memory_budget.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <gdal_priv.h>
+
+namespace gdiv::runner {
+
+namespace {
+    struct BudgetState {
+        std::mutex m;
+        std::condition_variable cv;
+        uint64_t total = 0;
+        uint64_t held = 0;            // reserved from the state share
+        long long gdal_default = -1;  // cache size before the first budget
+    };
+
+    BudgetState& state() {
+        static BudgetState s;
+        return s;
+    }
+
+    // A quarter for the block cache, the rest shared by tiles and raster state
+    MemoryShares split(uint64_t total) {
+        MemoryShares s;
+        if (total == 0) return s;
+        s.gdal_cache = total / 4;
+        s.buffers = total / 8 * 3;
+        s.state = total - s.gdal_cache - s.buffers;
+        return s;
+    }
+}
+
+void set_memory_budget(uint64_t bytes) {
+    BudgetState& s = state();
+    {
+        std::lock_guard<std::mutex> lk(s.m);
+        if (bytes && s.gdal_default < 0) s.gdal_default = GDALGetCacheMax64();
+        s.total = bytes;
+        if (bytes) GDALSetCacheMax64(static_cast<long long>(split(bytes).gdal_cache));
+        else if (s.gdal_default >= 0) GDALSetCacheMax64(s.gdal_default);
+    }
+    s.cv.notify_all();   // a larger share (or none) may admit waiters
+}
+
+uint64_t memory_budget() {
+    BudgetState& s = state();
+    std::lock_guard<std::mutex> lk(s.m);
+    return s.total;
+}
+
+MemoryShares memory_shares() {
+    return split(memory_budget());
+}
+
+MemoryReservation::MemoryReservation(uint64_t bytes, const std::atomic<bool>* cancel) {
+    BudgetState& s = state();
+    std::unique_lock<std::mutex> lk(s.m);
+    if (s.total == 0 || bytes == 0) return;
+    auto fits = [&] {
+        return s.total == 0 || s.held == 0 || s.held + bytes <= split(s.total).state;
+    };
+    if (!cancel) {
+        s.cv.wait(lk, fits);
+    } else {
+        // cancel is not tied to the condition variable: poll it
+        while (!fits()) {
+            if (cancel->load()) return;
+            s.cv.wait_for(lk, std::chrono::milliseconds(20));
+        }
+    }
+    if (s.total == 0) return;
+    bytes_ = bytes;
+    s.held += bytes;
+}
+
+MemoryReservation::~MemoryReservation() {
+    release();
+}
+
+MemoryReservation::MemoryReservation(MemoryReservation&& o) noexcept : bytes_(o.bytes_) {
+    o.bytes_ = 0;
+}
+
+MemoryReservation& MemoryReservation::operator=(MemoryReservation&& o) noexcept {
+    if (this != &o) {
+        release();
+        bytes_ = o.bytes_;
+        o.bytes_ = 0;
+    }
+    return *this;
+}
+
+void MemoryReservation::release() {
+    if (bytes_ == 0) return;
+    BudgetState& s = state();
+    {
+        std::lock_guard<std::mutex> lk(s.m);
+        s.held -= std::min(bytes_, s.held);
+        bytes_ = 0;
+    }
+    s.cv.notify_all();
+}
+
+} // namespace gdiv::runner
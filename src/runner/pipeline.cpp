@@ -0,0 +1,95 @@
+#include "gdiv/runner/pipeline.h"
+#include "gdiv/runner/memory_budget.h"
+#include "gdiv/runner/runner.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+namespace gdiv::runner {
+
+static const int MIN_BUDGET_TILE = 64;
+
+StagePlan plan_stages(const RunOptions& opt, int bands, size_t tasks,
+                      const std::vector<BlockGrid>& grids, double decode) {
+    const int total = resolve_threads(opt.threads, tasks);
+    const bool automatic = opt.io_threads <= 0 && opt.compute_threads <= 0;
+
+    StagePlan p;
+    // Split `threads` between the stages: compressed tiles keep every thread
+    // decoding (each reduces what it read), raw ones need a quarter at most
+    auto split = [&](int threads) {
+        if (threads == 1 || decode > 1.0) {
+            p.io = threads;
+            p.compute = 0;
+        } else {
+            p.io = std::max(1, threads / 4);
+            p.compute = std::max(1, threads - p.io);
+        }
+    };
+    if (automatic) {
+        split(total);
+    } else {
+        p.io = opt.io_threads > 0 ? opt.io_threads : std::max(1, total / 4);
+        p.compute = opt.compute_threads > 0 ? opt.compute_threads : std::max(1, total - p.io);
+    }
+    p.queue_depth = opt.queue_depth > 0 ? static_cast<size_t>(opt.queue_depth)
+                                        : static_cast<size_t>(2 * (p.io + p.compute));
+    p.tile = opt.tile;
+
+    const uint64_t share = memory_shares().buffers;
+    if (share == 0 || p.tile <= 0) return p;   // no budget, or whole-raster tiles
+
+    auto tile_bytes = [&](int t) {
+        uint64_t px = grids.empty() ? static_cast<uint64_t>(t) * t : 0;
+        for (const BlockGrid& g : grids)
+            px = std::max<uint64_t>(px, TileRange::for_grid(g, t).max_tile_pixels());
+        return std::max<uint64_t>(px, 1) * std::max(bands, 1) * sizeof(double);
+    };
+    while (p.tile > MIN_BUDGET_TILE && p.queue_depth * tile_bytes(p.tile) > share)
+        p.tile = std::max(MIN_BUDGET_TILE, p.tile / 2);
+
+    const size_t fit = static_cast<size_t>(std::max<uint64_t>(share / tile_bytes(p.tile), 2));
+    if (opt.queue_depth > 0 || p.queue_depth <= fit) return p;
+    p.queue_depth = fit;
+    if (automatic) {
+        // keep two buffers per thread, as without a budget
+        const int threads = std::max(2, static_cast<int>(fit / 2));
+        if (p.io + p.compute > threads) split(threads);
+    }
+    return p;
+}
+
+// ---------------------------
+// Buffer pool
+// ---------------------------
+BufferPool::BufferPool(size_t depth) : bufs_(std::max<size_t>(depth, 1)) {
+    free_.reserve(bufs_.size());
+    for (auto& b : bufs_) free_.push_back(&b);
+}
+
+TileBuffer* BufferPool::acquire() {
+    std::unique_lock<std::mutex> lk(m_);
+    cv_.wait(lk, [&] { return cancelled_ || !free_.empty(); });
+    if (cancelled_) return nullptr;
+    TileBuffer* b = free_.back();
+    free_.pop_back();
+    return b;
+}
+
+void BufferPool::release(TileBuffer* b) {
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        free_.push_back(b);
+    }
+    cv_.notify_one();
+}
+
+void BufferPool::cancel() {
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        cancelled_ = true;
+    }
+    cv_.notify_all();
+}
+
+} // namespace gdiv::runner
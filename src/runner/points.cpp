@@ -0,0 +1,127 @@
+#include "gdiv/runner/points.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include "gdiv/runner/memory_budget.h"
+#include "gdiv/runner/tiler.h"
+
+namespace gdiv::runner {
+
+size_t Disk::pixels() const {
+    size_t n = 0;
+    for (const Span& s : spans) n += static_cast<size_t>(s.len);
+    return n;
+}
+
+Disk make_disk(const double* gt, double radius) {
+    if (gt[2] != 0.0 || gt[4] != 0.0 || gt[1] == 0.0 || gt[5] == 0.0)
+        throw std::runtime_error("make_disk(): rotated geotransform");
+    if (!(radius >= 0.0)) throw std::runtime_error("make_disk(): negative radius");
+
+    const double pw = std::fabs(gt[1]), ph = std::fabs(gt[5]);
+    const double r2 = radius * radius * (1.0 + 1e-12);   // centers exactly on the circle count
+    Disk d;
+    d.rx = static_cast<int>(std::floor(radius / pw + 1e-9));
+    d.ry = static_cast<int>(std::floor(radius / ph + 1e-9));
+    d.spans.reserve(static_cast<size_t>(d.height()));
+    for (int dy = -d.ry; dy <= d.ry; ++dy) {
+        const double rest = r2 - (dy * ph) * (dy * ph);
+        int m = rest > 0.0 ? static_cast<int>(std::floor(std::sqrt(rest) / pw)) : 0;
+        m = std::min(m, d.rx);
+        d.spans.push_back(Disk::Span{dy, -m, 2 * m + 1});
+    }
+    return d;
+}
+
+PointPlan plan_points(GDALDataset* ds, const std::vector<GeoPoint>& points, double radius) {
+    if (!ds) throw std::runtime_error("plan_points(): null dataset");
+    double gt[6];
+    if (ds->GetGeoTransform(gt) != CE_None)
+        throw std::runtime_error("plan_points(): raster has no geotransform");
+
+    PointPlan plan;
+    plan.disk = make_disk(gt, radius);
+    const int W = ds->GetRasterXSize(), H = ds->GetRasterYSize();
+    const size_t n = points.size();
+    plan.px.resize(n);
+    plan.py.resize(n);
+
+    int side = 1;
+    while (side < std::max(W, H)) side *= 2;
+    std::vector<uint64_t> key(n);
+    for (size_t i = 0; i < n; ++i) {
+        if (!std::isfinite(points[i].x) || !std::isfinite(points[i].y))
+            throw std::runtime_error("plan_points(): non-finite coordinate");
+        const double fx = std::floor((points[i].x - gt[0]) / gt[1]);
+        const double fy = std::floor((points[i].y - gt[3]) / gt[5]);
+        plan.px[i] = static_cast<int>(std::clamp(fx, -1e9, 1e9));
+        plan.py[i] = static_cast<int>(std::clamp(fy, -1e9, 1e9));
+        key[i] = hilbert_index(side, std::clamp(plan.px[i], 0, side - 1), std::clamp(plan.py[i], 0, side - 1));
+    }
+    plan.order.resize(n);
+    std::iota(plan.order.begin(), plan.order.end(), 0u);
+    std::stable_sort(plan.order.begin(), plan.order.end(),
+                     [&](uint32_t a, uint32_t b) { return key[a] < key[b]; });
+    return plan;
+}
+
+BlockCache::BlockCache(GDALDataset* ds, int first_band, int bands, size_t max_bytes)
+    : ds_(ds), first_band_(first_band), bands_(std::max(1, bands)) {
+    if (!ds) throw std::runtime_error("BlockCache: null dataset");
+    width_ = ds->GetRasterXSize();
+    height_ = ds->GetRasterYSize();
+    if (ds->GetRasterCount() > 0) ds->GetRasterBand(1)->GetBlockSize(&bw_, &bh_);
+    if (bw_ <= 0) bw_ = 1;
+    if (bh_ <= 0) bh_ = 1;
+    const size_t block_bytes = static_cast<size_t>(bw_) * bh_ * bands_ * sizeof(double);
+    max_blocks_ = std::max<size_t>(1, max_bytes / block_bytes);
+}
+
+const double* BlockCache::get(int bx, int by, Window& win) {
+    const uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(by)) << 32) | static_cast<uint32_t>(bx);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        ++hits_;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        win = it->second->win;
+        return it->second->data.data();
+    }
+
+    ++misses_;
+    if (lru_.size() >= max_blocks_) {
+        // recycle the least recently used entry and its buffer
+        index_.erase(lru_.back().key);
+        lru_.splice(lru_.begin(), lru_, std::prev(lru_.end()));
+    } else {
+        lru_.emplace_front();
+    }
+    Entry& e = lru_.front();
+    e.key = key;
+    e.win = Window{bx * bw_, by * bh_, 0, 0};
+    e.win.w = std::min(bw_, width_ - e.win.x);
+    e.win.h = std::min(bh_, height_ - e.win.y);
+    try {
+        read_window(ds_, e.win, e.data, first_band_, bands_);
+    } catch (...) {
+        lru_.pop_front();
+        throw;
+    }
+    index_[key] = lru_.begin();
+    win = e.win;
+    return e.data.data();
+}
+
+uint64_t BlockCache::bytes() const {
+    uint64_t n = 0;
+    for (const Entry& e : lru_) n += e.data.capacity() * sizeof(double);
+    return n;
+}
+
+size_t point_cache_bytes(int workers) {
+    const MemoryShares shares = memory_shares();
+    if (shares.buffers == 0) return size_t(64) << 20;
+    return static_cast<size_t>(shares.buffers / static_cast<uint64_t>(std::max(1, workers)));
+}
+
+} // namespace gdiv::runner
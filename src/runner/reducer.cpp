@@ -0,0 +1,112 @@
+#include "gdiv/runner/reducer.h"
+#include "gdiv/runner/stats.h"
+#include "gdiv_lsi.h"
+#include <iterator>
+
+namespace gdiv::runner {
+
+void LsiReducer::init(const DatasetInfo& info) {
+    width = info.width;
+    height = info.height;
+    pieces.clear();
+    valid = patches = 0;
+}
+
+void LsiReducer::accumulate(const Block& blk) {
+    Piece p;
+    p.win = blk.win;
+    p.vals.resize(blk.pixels());
+    for (size_t i = 0; i < p.vals.size(); ++i) {
+        const double v = blk.data[i];
+        if (skip_value(v, blk.nodata)) { p.vals[i] = LSI_INVALID; continue; }
+        p.vals[i] = (int)std::llround(v);
+        ++valid;
+    }
+    pieces.push_back(std::move(p));
+}
+
+void LsiReducer::merge(LsiReducer&& o) {
+    pieces.insert(pieces.end(), std::make_move_iterator(o.pieces.begin()),
+                  std::make_move_iterator(o.pieces.end()));
+    o.pieces.clear();
+    valid += o.valid;
+}
+
+void LsiReducer::finalize(double* out) {
+    // Stitch the windows back into one class raster, then label it
+    std::vector<int> vals(static_cast<size_t>(width) * height, LSI_INVALID);
+    BufferUse held(vals.size() * sizeof(int));
+    for (const auto& p : pieces) {
+        for (int r = 0; r < p.win.h; ++r) {
+            std::copy_n(p.vals.data() + static_cast<size_t>(r) * p.win.w, p.win.w,
+                        vals.data() + static_cast<size_t>(p.win.y + r) * width + p.win.x);
+        }
+    }
+    pieces.clear();
+
+    LsiScan scan;
+    lsi_scan(vals.data(), width, height, connectivity >= 8, scan);
+    patches = scan.patches;
+    stats_add(Counter::Patches, patches);
+    out[0] = (scan.patches > 0) ? (double)(scan.sum_ratio / (long double)scan.patches)
+                                : std::numeric_limits<double>::quiet_NaN();
+}
+
+void JointReducer::finalize(double* out) {
+    // table cells as (row, column, count), classes numbered in order of appearance
+    struct Cell { size_t a, b; uint64_t n; };
+    std::vector<Cell> cells;
+    std::vector<uint64_t> rows, cols;
+    if (!counts.empty()) {
+        rows.assign(na, 0);
+        cols.assign(nb, 0);
+        for (size_t i = 0; i < counts.size(); ++i)
+            if (counts[i]) cells.push_back({i / nb, i % nb, counts[i]});
+    } else {
+        std::unordered_map<long long, size_t> ra, cb;
+        for (const auto& kv : pairs) {
+            const size_t r = ra.emplace(kv.first.first, ra.size()).first->second;
+            const size_t c = cb.emplace(kv.first.second, cb.size()).first->second;
+            cells.push_back({r, c, kv.second});
+        }
+        rows.assign(ra.size(), 0);
+        cols.assign(cb.size(), 0);
+    }
+    for (const Cell& c : cells) { rows[c.a] += c.n; cols[c.b] += c.n; }
+
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    if (total == 0) {
+        std::fill(out, out + metrics, nan);
+        return;
+    }
+    const long double N = static_cast<long double>(total);
+    auto entropy = [&](const std::vector<uint64_t>& sums, size_t& used) {
+        long double H = 0.0L;
+        used = 0;
+        for (uint64_t n : sums) {
+            if (!n) continue;
+            const long double p = n / N;
+            H -= p * std::log(p);
+            ++used;
+        }
+        return H;
+    };
+    size_t ka = 0, kb = 0;
+    const long double Ha = entropy(rows, ka), Hb = entropy(cols, kb);
+    long double Hab = 0.0L, ratio = 0.0L;   // ratio: sum of n_ij^2 / (r_i c_j)
+    for (const Cell& c : cells) {
+        const long double p = c.n / N;
+        Hab -= p * std::log(p);
+        ratio += (long double)c.n * c.n / ((long double)rows[c.a] * cols[c.b]);
+    }
+
+    out[0] = static_cast<double>(Ha);
+    out[1] = static_cast<double>(Hb);
+    out[2] = static_cast<double>(Hab);
+    out[3] = static_cast<double>(std::max(0.0L, Ha + Hb - Hab));
+    // chi^2 = N (ratio - 1), V = sqrt(chi^2 / (N (min(k_a, k_b) - 1)))
+    const size_t k = std::min(ka, kb);
+    out[4] = k > 1 ? static_cast<double>(std::sqrt(std::max(0.0L, ratio - 1) / (k - 1))) : nan;
+}
+
+} // namespace gdiv::runner
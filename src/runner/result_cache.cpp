@@ -0,0 +1,213 @@
+#include "gdiv/runner/result_cache.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
+#if defined(_WIN32) || defined(_WIN64)
+  #include <process.h>
+#else
+  #include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace gdiv::runner {
+
+static const char CACHE_MAGIC[8] = {'G','D','I','V','R','C','1','\n'};
+static const char* const CACHE_EXT = ".gdc";
+
+namespace {
+    struct CacheState {
+        std::mutex m;
+        fs::path dir;
+        uint64_t max_bytes = 0;
+        uint64_t bytes = 0;              // approximate size of dir
+        std::atomic<bool> on{false};
+    };
+
+    CacheState& state() {
+        static CacheState s;
+        return s;
+    }
+}
+
+static uint64_t fnv1a64(const std::string& s) {
+    uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static fs::path entry_path(const fs::path& dir, const std::string& identity) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(fnv1a64(identity)));
+    return dir / (std::string(name) + CACHE_EXT);
+}
+
+// Entries of dir, oldest first
+static std::vector<std::pair<fs::file_time_type, fs::path>> list_entries(const fs::path& dir, uint64_t& bytes) {
+    std::vector<std::pair<fs::file_time_type, fs::path>> out;
+    bytes = 0;
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().extension() != CACHE_EXT) continue;
+        std::error_code e2;
+        const uint64_t sz = it->file_size(e2);
+        if (e2) continue;
+        bytes += sz;
+        out.emplace_back(it->last_write_time(e2), it->path());
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+// Caller holds the lock. Trim to 90% of the cap so eviction is not run per store.
+static void evict(CacheState& s) {
+    auto entries = list_entries(s.dir, s.bytes);
+    const uint64_t target = s.max_bytes / 10 * 9;
+    for (const auto& e : entries) {
+        if (s.bytes <= target) break;
+        std::error_code ec;
+        const uint64_t sz = fs::file_size(e.second, ec);
+        if (!ec && fs::remove(e.second, ec)) s.bytes -= std::min(sz, s.bytes);
+    }
+}
+
+void set_result_cache(const std::string& dir, uint64_t max_bytes) {
+    CacheState& s = state();
+    std::lock_guard<std::mutex> lk(s.m);
+    s.on = false;
+    if (dir.empty()) return;
+
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (!fs::is_directory(dir, ec)) return;
+    s.dir = dir;
+    s.max_bytes = max_bytes ? max_bytes : (1ull << 30);
+    list_entries(s.dir, s.bytes);
+    if (s.bytes > s.max_bytes) evict(s);
+    s.on = true;
+}
+
+bool result_cache_enabled() {
+    return state().on.load();
+}
+
+std::string cache_identity(const std::string& path, const std::string& tag) {
+    std::error_code ec;
+    const fs::path abs = fs::absolute(path, ec);
+    if (ec) return {};
+    const uint64_t size = fs::file_size(abs, ec);
+    if (ec) return {};
+    const auto mtime = fs::last_write_time(abs, ec);
+    if (ec) return {};
+
+    return abs.generic_string() + "|" + std::to_string(size) + "|"
+         + std::to_string(static_cast<long long>(mtime.time_since_epoch().count())) + "|" + tag;
+}
+
+bool cache_lookup(const std::string& identity, std::vector<double>& values) {
+    CacheState& s = state();
+    if (!s.on || identity.empty()) return false;
+    fs::path file;
+    {
+        std::lock_guard<std::mutex> lk(s.m);
+        file = entry_path(s.dir, identity);
+    }
+
+    std::FILE* f = std::fopen(file.string().c_str(), "rb");
+    if (!f) return false;
+    char magic[sizeof(CACHE_MAGIC)];
+    uint32_t id_len = 0, n = 0;
+    bool ok = std::fread(magic, 1, sizeof(magic), f) == sizeof(magic)
+           && std::memcmp(magic, CACHE_MAGIC, sizeof(magic)) == 0
+           && std::fread(&id_len, sizeof(id_len), 1, f) == 1;
+    std::string id;
+    if (ok) {
+        id.resize(id_len);
+        ok = std::fread(&id[0], 1, id_len, f) == id_len;
+    }
+    const bool other_key = ok && id != identity;   // 64-bit name collision: just a miss
+    ok = ok && !other_key && std::fread(&n, sizeof(n), 1, f) == 1;
+    std::vector<double> vals;
+    if (ok) {
+        vals.resize(n);
+        ok = std::fread(vals.data(), sizeof(double), n, f) == n;
+    }
+    std::fclose(f);
+
+    std::error_code ec;
+    if (!ok) {
+        if (!other_key) fs::remove(file, ec);   // truncated or foreign file
+        return false;
+    }
+    fs::last_write_time(file, fs::file_time_type::clock::now(), ec);   // LRU touch
+    values = std::move(vals);
+    return true;
+}
+
+// Temp file suffix no other writer uses: processes sharing the directory
+// differ by pid, threads by id, repeated stores by the counter
+static std::string temp_suffix() {
+    static std::atomic<uint64_t> counter{0};
+#if defined(_WIN32) || defined(_WIN64)
+    const long long pid = _getpid();
+#else
+    const long long pid = getpid();
+#endif
+    return "." + std::to_string(pid) + "."
+         + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + "."
+         + std::to_string(counter.fetch_add(1)) + ".tmp";
+}
+
+void cache_store(const std::string& identity, const std::vector<double>& values) {
+    CacheState& s = state();
+    if (!s.on || identity.empty()) return;
+    fs::path file;
+    {
+        std::lock_guard<std::mutex> lk(s.m);
+        file = entry_path(s.dir, identity);
+    }
+
+    // write aside, then rename: readers never see half an entry
+    fs::path tmp = file;
+    tmp += temp_suffix();
+    std::FILE* f = std::fopen(tmp.string().c_str(), "wb");
+    if (!f) return;
+    const uint32_t id_len = static_cast<uint32_t>(identity.size());
+    const uint32_t n = static_cast<uint32_t>(values.size());
+    bool ok = std::fwrite(CACHE_MAGIC, 1, sizeof(CACHE_MAGIC), f) == sizeof(CACHE_MAGIC)
+           && std::fwrite(&id_len, sizeof(id_len), 1, f) == 1
+           && std::fwrite(identity.data(), 1, id_len, f) == id_len
+           && std::fwrite(&n, sizeof(n), 1, f) == 1
+           && std::fwrite(values.data(), sizeof(double), n, f) == n;
+    ok = (std::fclose(f) == 0) && ok;
+
+    std::error_code ec;
+    if (ok) fs::rename(tmp, file, ec);
+    if (!ok || ec) { fs::remove(tmp, ec); return; }
+
+    std::lock_guard<std::mutex> lk(s.m);
+    s.bytes += sizeof(CACHE_MAGIC) + 2 * sizeof(uint32_t) + id_len + n * sizeof(double);
+    if (s.bytes > s.max_bytes) evict(s);
+}
+
+void clear_result_cache() {
+    CacheState& s = state();
+    std::lock_guard<std::mutex> lk(s.m);
+    if (s.dir.empty()) return;
+    uint64_t bytes = 0;
+    for (const auto& e : list_entries(s.dir, bytes)) {
+        std::error_code ec;
+        fs::remove(e.second, ec);
+    }
+    s.bytes = 0;
+}
+
+} // namespace gdiv::runner
@@ -1,88 +1,258 @@
 #include "gdiv/runner/runner.h"
-#include "gdiv/runner/tiler.h"
+#include <algorithm>
 #include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <mutex>
 #include <thread>
-#include <future>
-#include <numeric>
-#include <unordered_map>
 
 namespace gdiv::runner {
 
-Result process_many(
-    const std::vector<std::string>& rasters,
-    const RunOptions& opt,
-    const std::function<void(const std::vector<double>&, int, int, int,
-                             std::optional<double>)>& on_tile,
-    const std::function<double()>& on_finish)
-{
-    Result R;
-    R.values.reserve(rasters.size());
-
-    for (const auto& path : rasters) {
-        auto ds = open_readonly(path);
-        DatasetInfo info = describe(ds.get());
-        const int bands = (opt.band_count == 0)
-                        ? (opt.use_all_bands ? info.bands : 1)
-                        : opt.band_count;
-        const int first  = opt.first_band;
-
-        auto tiles = make_tiles(info.width, info.height, opt.tile);
-
-        std::vector<double> buf;
-        for (const auto& win : tiles) {
-            read_window(ds.get(), win, buf, first, bands);
-            on_tile(buf, win.w, win.h, bands,
-                    opt.nodata_override.has_value() ? opt.nodata_override
-                                                    : info.nodata);
+int resolve_threads(int requested, size_t jobs) {
+    int n = requested;
+    if (n <= 0) {
+        n = static_cast<int>(std::thread::hardware_concurrency());
+        if (n <= 0) n = 1;
+    }
+    if (jobs < static_cast<size_t>(n)) n = static_cast<int>(std::max<size_t>(jobs, 1));
+    return n;
+}
+
+// ---------------------------
+// Worker threads
+// ---------------------------
+// Workers park between calls, so their dataset pools (gdal_io.h) and memory
+// maps serve the next call too. A call takes idle workers and starts new ones
+// only when none is idle, so nested run_workers calls cannot starve.
+
+namespace {
+
+    // Jobs handed out by one call; the caller waits until `left` is 0
+    struct Batch {
+        std::mutex m;
+        std::condition_variable cv;
+        int left = 0;
+        std::exception_ptr err;
+    };
+
+    struct Worker {
+        std::mutex m;
+        std::condition_variable cv;
+        std::function<void()> job;   // empty while parked
+        Batch* batch = nullptr;
+        size_t id = 0;               // start order
+    };
+
+    struct WorkerSet {
+        std::mutex m;
+        std::vector<std::unique_ptr<Worker>> all;
+        std::vector<Worker*> idle;
+    };
+
+    // Never destroyed: parked workers end with the process
+    WorkerSet& worker_set() {
+        static WorkerSet* set = new WorkerSet;
+        return *set;
+    }
+
+    void worker_loop(Worker* w) {
+        for (;;) {
+            std::function<void()> job;
+            Batch* b;
+            {
+                std::unique_lock<std::mutex> lk(w->m);
+                w->cv.wait(lk, [w] { return static_cast<bool>(w->job); });
+                job = std::move(w->job);
+                w->job = nullptr;
+                b = w->batch;
+            }
+            std::exception_ptr err;
+            try { job(); } catch (...) { err = std::current_exception(); }
+            job = nullptr;   // release captures before the caller returns
+
+            {
+                WorkerSet& set = worker_set();
+                std::lock_guard<std::mutex> lk(set.m);
+                set.idle.push_back(w);
+            }
+            std::lock_guard<std::mutex> lk(b->m);
+            if (err && !b->err) b->err = err;
+            if (--b->left == 0) b->cv.notify_all();
+        }
+    }
+
+    // n idle workers, oldest first so worker t of a call tends to be the same
+    // thread (and dataset pool) as in the previous call; started as needed
+    std::vector<Worker*> take_workers(size_t n) {
+        WorkerSet& set = worker_set();
+        std::lock_guard<std::mutex> lk(set.m);
+        std::sort(set.idle.begin(), set.idle.end(), [](const Worker* a, const Worker* b) { return a->id > b->id; });
+        std::vector<Worker*> ws;
+        while (ws.size() < n && !set.idle.empty()) {
+            ws.push_back(set.idle.back());
+            set.idle.pop_back();
+        }
+        while (ws.size() < n) {
+            set.all.push_back(std::make_unique<Worker>());
+            Worker* w = set.all.back().get();
+            w->id = set.all.size() - 1;
+            std::thread(worker_loop, w).detach();
+            ws.push_back(w);
+        }
+        return ws;
+    }
+
+    // Runs job(i) on ws[i] and waits for all of them; rethrows the first error
+    void run_on(const std::vector<Worker*>& ws, const std::function<void(size_t)>& job) {
+        Batch batch;
+        batch.left = static_cast<int>(ws.size());
+        for (size_t i = 0; i < ws.size(); ++i) {
+            std::lock_guard<std::mutex> lk(ws[i]->m);
+            ws[i]->job = [&job, i] { job(i); };
+            ws[i]->batch = &batch;
+            ws[i]->cv.notify_one();
+        }
+        std::unique_lock<std::mutex> lk(batch.m);
+        batch.cv.wait(lk, [&] { return batch.left == 0; });
+        if (batch.err) std::rethrow_exception(batch.err);
+    }
+
+} // namespace
+
+void close_pooled_datasets() {
+    thread_dataset_pool().clear();
+
+    std::vector<Worker*> idle;
+    {
+        WorkerSet& set = worker_set();
+        std::lock_guard<std::mutex> lk(set.m);
+        idle.swap(set.idle);
+    }
+    if (!idle.empty()) run_on(idle, [](size_t) { thread_dataset_pool().clear(); });
+}
+
+namespace detail {
+
+void run_workers(int n, const std::function<void(int)>& body) {
+    if (n <= 1) { body(0); return; }
+
+    // workers report into the caller's stats
+    StatsSink* sink = current_stats();
+    run_on(take_workers(static_cast<size_t>(n)), [&body, sink](size_t t) {
+        StatsScope scope(sink);
+        if (tracing()) set_trace_thread_name("worker " + std::to_string(t));
+        body(static_cast<int>(t));
+    });
+}
+
+std::string run_tag(const std::string& reducer, int metrics, const RunOptions& opt) {
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), " metrics=%d first_band=%d band_count=%d all_bands=%d nodata=",
+                  metrics, opt.first_band, opt.band_count, opt.use_all_bands ? 1 : 0);
+    std::string tag = reducer + buf;
+    if (opt.nodata_override.has_value()) {
+        std::snprintf(buf, sizeof(buf), "%.17g", *opt.nodata_override);
+        tag += buf;
+    } else {
+        tag += "file";
+    }
+    return tag;
+}
+
+int band_count(const RunOptions& opt, const DatasetInfo& info) {
+    return (opt.band_count == 0) ? (opt.use_all_bands ? info.bands : 1)
+                                 : opt.band_count;
+}
+
+int planned_bands(const std::vector<std::string>& rasters, const std::vector<bool>& skip,
+                  const RunOptions& opt) {
+    if (opt.band_count > 0) return opt.band_count;
+    if (!opt.use_all_bands || memory_budget() == 0) return 1;
+    for (size_t r = 0; r < rasters.size(); ++r) {
+        if (skip[r]) continue;
+        try {
+            return std::max(1, describe(open_pooled(rasters[r]).get()).bands);
+        } catch (const std::exception&) {
+            return 1;   // the reader reports it
         }
+    }
+    return 1;
+}
 
-        R.values.push_back(on_finish());
+size_t planned_tasks(const std::vector<std::string>& rasters, const std::vector<bool>& skip,
+                     const RunOptions& opt) {
+    size_t pending = 0;
+    for (size_t r = 0; r < rasters.size(); ++r) pending += skip[r] ? 0 : 1;
+    if (pending >= static_cast<size_t>(resolve_threads(opt.threads, std::numeric_limits<size_t>::max())))
+        return pending;
+
+    size_t tasks = 0;
+    for (size_t r = 0; r < rasters.size(); ++r) {
+        if (skip[r]) continue;
+        try {
+            SharedDataset ds = open_pooled(rasters[r]);
+            const DatasetInfo info = describe(ds.get());
+            const TileRange tiles = TileRange::for_dataset(ds.get(), opt.tile, opt.order);
+            tasks += split_count(estimate_cost(info, band_count(opt, info)), tiles.size(), opt);
+        } catch (const std::exception&) {
+            tasks += 1;   // the reader reports it
+        }
     }
-    return R;
+    return std::max<size_t>(tasks, 1);
 }
 
+double planned_decode(const std::vector<std::string>& rasters, const std::vector<bool>& skip,
+                      const RunOptions& opt) {
+    if (opt.io_threads > 0 || opt.compute_threads > 0) return 1.0;
+    for (size_t r = 0; r < rasters.size(); ++r) {
+        if (skip[r]) continue;
+        try {
+            return compression_factor(describe(open_pooled(rasters[r]).get()).compression);
+        } catch (const std::exception&) {
+            return 1.0;   // the reader reports it
+        }
+    }
+    return 1.0;
+}
+
+std::vector<BlockGrid> planned_grids(const std::vector<std::string>& rasters,
+                                     const std::vector<bool>& skip, const RunOptions& opt) {
+    std::vector<BlockGrid> grids;
+    if (opt.tile <= 0 || memory_budget() == 0) return grids;
+    for (size_t r = 0; r < rasters.size(); ++r) {
+        if (skip[r]) continue;
+        try {
+            grids.push_back(BlockGrid::of(open_pooled(rasters[r]).get()));
+        } catch (const std::exception&) {
+            // the reader reports it
+        }
+    }
+    std::sort(grids.begin(), grids.end());
+    grids.erase(std::unique(grids.begin(), grids.end()), grids.end());
+    return grids;
+}
+
+bool same_grid(GDALDataset* a, GDALDataset* b) {
+    double ga[6], gb[6];
+    if (a->GetGeoTransform(ga) != CE_None || b->GetGeoTransform(gb) != CE_None) return true;
+    const double px = std::max(std::fabs(ga[1]) + std::fabs(ga[2]), 1e-12);
+    const double py = std::max(std::fabs(ga[4]) + std::fabs(ga[5]), 1e-12);
+    return std::fabs(ga[0] - gb[0]) <= 0.1 * px && std::fabs(ga[3] - gb[3]) <= 0.1 * py
+        && std::fabs(ga[1] - gb[1]) <= 1e-6 * px && std::fabs(ga[2] - gb[2]) <= 1e-6 * px
+        && std::fabs(ga[4] - gb[4]) <= 1e-6 * py && std::fabs(ga[5] - gb[5]) <= 1e-6 * py;
+}
+
+} // namespace detail
+
 // ---------------------------
 // EXAMPLE: WHOLE SHDI
 // ---------------------------
 Result process_many_shdi(const std::vector<std::string>& rasters,
                          const RunOptions& opt)
 {
-    std::unordered_map<long long, uint64_t> hist;
-    uint64_t total = 0;
-
-    auto clear_agg = [&](){ hist.clear(); total = 0; };
-
-    auto on_tile = [&](const std::vector<double>& data, int w, int h, int bands,
-                       std::optional<double> nodata) {
-
-        (void)bands;
-        const size_t n = static_cast<size_t>(w) * h;
-        for (size_t i = 0; i < n; ++i) {
-            const double v = data[i];
-            if (nodata && std::isfinite(*nodata) && v == *nodata) continue;
-            if (!std::isfinite(v)) continue;
-
-            // make double int
-            // if int, then static_cast<long long>(v)
-            long long key = static_cast<long long>(std::llround(v));
-            ++hist[key];
-            ++total;
-        }
-    };
-
-    auto on_finish = [&](){
-        if (total == 0) return 0.0;
-        long double H = 0.0L;
-        for (const auto& kv : hist) {
-            const long double p = static_cast<long double>(kv.second) / total;
-            if (p > 0) H -= p * std::log(p);
-        }
-        const double ans = static_cast<double>(H);
-        clear_agg();
-        return ans;
-    };
-
-    return process_many(rasters, opt, on_tile, on_finish);
+    return process_many(rasters, opt, ShdiReducer{});
 }
 
 } // namespace gdiv::runner
@@ -0,0 +1,145 @@
+#include "gdiv/runner/scheduler.h"
+#include "gdiv/runner/runner.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cpl_vsi.h>
+
+namespace gdiv::runner {
+
+double compression_factor(const std::string& comp) {
+    std::string c(comp);
+    std::transform(c.begin(), c.end(), c.begin(), [](unsigned char ch){ return (char)std::toupper(ch); });
+    if (c.empty() || c == "NONE") return 1.0;
+    if (c == "PACKBITS") return 1.2;
+    if (c == "ZSTD" || c == "LZ4") return 1.6;
+    if (c == "LZW") return 2.0;
+    if (c == "DEFLATE" || c == "LERC" || c == "LERC_DEFLATE" || c == "LERC_ZSTD") return 2.5;
+    if (c == "LZMA" || c == "JPEG" || c == "WEBP" || c == "JXL") return 3.0;
+    return 2.0;
+}
+
+double estimate_cost(const DatasetInfo& info, int bands) {
+    return static_cast<double>(info.width) * info.height * std::max(bands, 1)
+         * compression_factor(info.compression);
+}
+
+// ---------------------------
+// Work-stealing queues
+// ---------------------------
+WorkQueues::WorkQueues(int workers) {
+    lanes_.reserve(std::max(workers, 1));
+    for (int i = 0; i < std::max(workers, 1); ++i) lanes_.push_back(std::make_unique<Lane>());
+}
+
+void WorkQueues::wake() {
+    {
+        std::lock_guard<std::mutex> lk(idle_m_);
+        ++epoch_;
+    }
+    idle_cv_.notify_all();
+}
+
+void WorkQueues::push(int worker, Task t) {
+    ++outstanding_;
+    {
+        Lane& lane = *lanes_[worker];
+        std::lock_guard<std::mutex> lk(lane.m);
+        lane.q.push_front(std::move(t));
+    }
+    wake();
+}
+
+void WorkQueues::push_back(int worker, Task t) {
+    ++outstanding_;
+    {
+        Lane& lane = *lanes_[worker];
+        std::lock_guard<std::mutex> lk(lane.m);
+        lane.q.push_back(std::move(t));
+    }
+    wake();
+}
+
+bool WorkQueues::take(int worker, Task& t) {
+    const size_t n = lanes_.size();
+    {   // own deque, front
+        Lane& own = *lanes_[worker];
+        std::lock_guard<std::mutex> lk(own.m);
+        if (!own.q.empty()) {
+            t = std::move(own.q.front());
+            own.q.pop_front();
+            return true;
+        }
+    }
+    // steal from the back of the others, starting at the right neighbour
+    for (size_t k = 1; k < n; ++k) {
+        Lane& victim = *lanes_[(worker + k) % n];
+        std::lock_guard<std::mutex> lk(victim.m);
+        if (!victim.q.empty()) {
+            t = std::move(victim.q.back());
+            victim.q.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WorkQueues::try_next(int worker, Task& t) {
+    return !cancelled_ && take(worker, t);
+}
+
+bool WorkQueues::next(int worker, Task& t) {
+    while (!cancelled_) {
+        uint64_t seen;
+        {
+            std::lock_guard<std::mutex> lk(idle_m_);
+            seen = epoch_;
+        }
+        if (take(worker, t)) return true;
+        // nothing queued: done, unless a running task may still split
+        if (outstanding_.load() == 0) return false;
+        std::unique_lock<std::mutex> lk(idle_m_);
+        idle_cv_.wait(lk, [&] { return epoch_ != seen || cancelled_ || outstanding_.load() == 0; });
+    }
+    return false;
+}
+
+void WorkQueues::done() {
+    if (--outstanding_ == 0) wake();
+}
+
+void WorkQueues::cancel() {
+    cancelled_ = true;
+    wake();
+}
+
+void seed_tasks(WorkQueues& queues, const std::vector<std::string>& rasters, int workers,
+                const std::vector<bool>& skip) {
+    // file size is the only cost known without opening; stat is cheap
+    std::vector<long long> bytes(rasters.size(), 0);
+    for (size_t i = 0; i < rasters.size(); ++i) {
+        if (i < skip.size() && skip[i]) continue;
+        VSIStatBufL st;
+        if (VSIStatL(rasters[i].c_str(), &st) == 0) bytes[i] = static_cast<long long>(st.st_size);
+    }
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < rasters.size(); ++i)
+        if (i >= skip.size() || !skip[i]) order.push_back(i);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return bytes[a] > bytes[b]; });
+
+    for (size_t k = 0; k < order.size(); ++k)
+        queues.push_back(static_cast<int>(k % std::max(workers, 1)), Task{order[k], -1, TileRange()});
+}
+
+size_t split_count(double cost, size_t tiles, const RunOptions& opt) {
+    if (tiles <= 1) return 1;
+
+    size_t n = (tiles + SPLIT_TILES - 1) / SPLIT_TILES;
+    if (opt.task_cost > 0 && cost > opt.task_cost)
+        n = std::max(n, static_cast<size_t>(std::ceil(cost / opt.task_cost)));
+    return std::min(n, tiles);
+}
+
+} // namespace gdiv::runner
@@ -0,0 +1,43 @@
+#include "gdiv/runner/stats.h"
+
+namespace gdiv::runner {
+
+static thread_local StatsSink* t_sink = nullptr;
+
+StatsSink* current_stats() { return t_sink; }
+
+StatsScope::StatsScope(StatsSink* sink) : prev_(t_sink) { t_sink = sink; }
+
+StatsScope::~StatsScope() { t_sink = prev_; }
+
+void StatsSink::buffer(int64_t delta) {
+    const int64_t now = live_.fetch_add(delta, std::memory_order_relaxed) + delta;
+    int64_t peak = peak_.load(std::memory_order_relaxed);
+    while (now > peak && !peak_.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {}
+}
+
+CallStats StatsSink::snapshot() const {
+    auto sec = [&](Stage s) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::duration(
+            static_cast<std::chrono::steady_clock::rep>(ticks_[static_cast<int>(s)].load())
+        )).count();
+    };
+    auto num = [&](Counter c) { return counters_[static_cast<int>(c)].load(); };
+
+    CallStats st;
+    st.open_seconds = sec(Stage::Open);
+    st.read_seconds = sec(Stage::Read);
+    st.convert_seconds = sec(Stage::Convert);
+    st.compute_seconds = sec(Stage::Compute);
+    st.label_seconds = sec(Stage::Label);
+    st.datasets_opened = num(Counter::Opened);
+    st.bytes_read = num(Counter::BytesRead);
+    st.blocks_read = num(Counter::BlocksRead);
+    st.pixels = num(Counter::Pixels);
+    st.pixels_valid = num(Counter::Valid);
+    st.patches = num(Counter::Patches);
+    st.peak_buffer_bytes = static_cast<uint64_t>(peak_.load());
+    return st;
+}
+
+} // namespace gdiv::runner
@@ -1,19 +1,162 @@
 #include "gdiv/runner/tiler.h"
+#include <algorithm>
+#include <utility>
 
 namespace gdiv::runner {
 
-    std::vector<Window> make_tiles(int width, int height, int tile) {
-        std::vector<Window> tiles;
-        if (tile <= 0) { tiles.push_back({0,0,width,height}); return tiles; }
-
-        for (int y = 0; y < height; y += tile) {
-            const int h = std::min(tile, height - y);
-            for (int x = 0; x < width; x += tile) {
-                const int w = std::min(tile, width - x);
-                tiles.push_back({x, y, w, h});
+    // Hilbert curve index -> cell (n = side, power of two)
+    static void hilbert_d2xy(int n, uint64_t d, int& x, int& y) {
+        x = y = 0;
+        for (int s = 1; s < n; s *= 2) {
+            const int rx = static_cast<int>(1 & (d / 2));
+            const int ry = static_cast<int>(1 & (d ^ static_cast<uint64_t>(rx)));
+            if (ry == 0) {
+                if (rx == 1) { x = s - 1 - x; y = s - 1 - y; }
+                std::swap(x, y);
+            }
+            x += s * rx;
+            y += s * ry;
+            d /= 4;
+        }
+    }
+
+    uint64_t hilbert_index(int side, int x, int y) {
+        uint64_t d = 0;
+        for (int s = side / 2; s > 0; s /= 2) {
+            const int rx = (x & s) > 0 ? 1 : 0;
+            const int ry = (y & s) > 0 ? 1 : 0;
+            d += static_cast<uint64_t>(s) * static_cast<uint64_t>(s) * static_cast<uint64_t>((3 * rx) ^ ry);
+            if (ry == 0) {   // rotate the quadrant
+                if (rx == 1) { x = side - 1 - x; y = side - 1 - y; }
+                std::swap(x, y);
+            }
+        }
+        return d;
+    }
+
+    // Morton code -> cell
+    static void morton_decode(uint64_t d, int& x, int& y) {
+        x = y = 0;
+        for (int b = 0; b < 32; ++b) {
+            x |= static_cast<int>((d >> (2 * b)) & 1) << b;
+            y |= static_cast<int>((d >> (2 * b + 1)) & 1) << b;
+        }
+    }
+
+    // Tile edge rounded to whole blocks; a block spanning the raster spans the tile too
+    static int align_to_block(int tile, int block, int extent) {
+        if (block <= 0 || tile <= 0) return tile;
+        if (block >= extent) return extent;
+        return std::max(block, tile / block * block);
+    }
+
+    TileRange::TileRange(int width, int height, int tile_w, int tile_h, TileOrder order)
+        : width_(width), height_(height), order_(order)
+    {
+        tile_w_ = (tile_w <= 0) ? width : std::min(tile_w, width);
+        tile_h_ = (tile_h <= 0) ? height : std::min(tile_h, height);
+        if (order == TileOrder::Strip) tile_w_ = width;
+
+        if (width <= 0 || height <= 0) { tile_w_ = tile_h_ = 0; return; }
+        cols_ = (width + tile_w_ - 1) / tile_w_;
+        rows_ = (height + tile_h_ - 1) / tile_h_;
+        count_ = static_cast<size_t>(cols_) * rows_;
+
+        if (order == TileOrder::Hilbert || order == TileOrder::ZOrder) {
+            side_ = 1;
+            while (side_ < std::max(cols_, rows_)) side_ *= 2;
+            pos_end_ = static_cast<uint64_t>(side_) * side_;
+        } else {
+            pos_end_ = count_;
+        }
+    }
+
+    BlockGrid BlockGrid::of(GDALDataset* ds) {
+        BlockGrid g;
+        g.width = ds->GetRasterXSize();
+        g.height = ds->GetRasterYSize();
+        if (ds->GetRasterCount() > 0) ds->GetRasterBand(1)->GetBlockSize(&g.block_w, &g.block_h);
+        return g;
+    }
+
+    TileRange TileRange::for_dataset(GDALDataset* ds, int tile, TileOrder order) {
+        return for_grid(BlockGrid::of(ds), tile, order);
+    }
+
+    TileRange TileRange::for_grid(const BlockGrid& g, int tile, TileOrder order) {
+        if (tile <= 0) return TileRange(g.width, g.height, g.width, g.height, order);
+        int tw = order == TileOrder::Strip ? g.width : align_to_block(tile, g.block_w, g.width);
+        int th = align_to_block(tile, g.block_h, g.height);
+
+        // Keep the area near tile^2: full-width blocks (striped files) would
+        // otherwise make every tile a strip of the whole raster width
+        const int64_t area = static_cast<int64_t>(tile) * tile;
+        if (static_cast<int64_t>(tw) * th > area) {
+            const int step = std::max(1, std::min(g.block_h, g.height));
+            th = std::max(step, static_cast<int>(area / tw) / step * step);
+        }
+        if (static_cast<int64_t>(tw) * th > area && order != TileOrder::Strip
+            && (g.block_w <= 0 || g.block_w >= g.width))
+            tw = std::max(1, static_cast<int>(area / th));
+        return TileRange(g.width, g.height, tw, th, order);
+    }
+
+    bool TileRange::cell_at(uint64_t pos, int& tx, int& ty) const {
+        switch (order_) {
+            case TileOrder::Hilbert: hilbert_d2xy(side_, pos, tx, ty); break;
+            case TileOrder::ZOrder:  morton_decode(pos, tx, ty); break;
+            default:
+                tx = static_cast<int>(pos % cols_);
+                ty = static_cast<int>(pos / cols_);
+                break;
+        }
+        return tx < cols_ && ty < rows_;
+    }
+
+    uint64_t TileRange::next_valid(uint64_t pos) const {
+        int tx, ty;
+        while (pos < pos_end_ && !cell_at(pos, tx, ty)) ++pos;
+        return std::min(pos, pos_end_);
+    }
+
+    Window TileRange::window_at(uint64_t pos) const {
+        int tx = 0, ty = 0;
+        cell_at(pos, tx, ty);
+        const int x = tx * tile_w_, y = ty * tile_h_;
+        return {x, y, std::min(tile_w_, width_ - x), std::min(tile_h_, height_ - y)};
+    }
+
+    std::vector<TileRange> TileRange::chunks(size_t n) const {
+        std::vector<TileRange> out;
+        if (count_ == 0) return out;
+        n = std::max<size_t>(1, std::min(n, count_));
+
+        // Walk the order once, cutting after every count_/n valid tiles
+        TileRange piece = *this;
+        size_t seen = 0, k = 0;
+        uint64_t start = pos_begin_;
+        for (uint64_t pos = next_valid(pos_begin_); pos < pos_end_; pos = next_valid(pos + 1)) {
+            ++seen;
+            if (seen == count_ * (k + 1) / n) {
+                piece.pos_begin_ = start;
+                piece.pos_end_ = pos + 1;
+                piece.count_ = count_ * (k + 1) / n - count_ * k / n;
+                out.push_back(piece);
+                start = pos + 1;
+                ++k;
             }
         }
-        return tiles;
+        return out;
+    }
+
+    size_t TileRange::max_tile_pixels() const {
+        return static_cast<size_t>(tile_w_) * tile_h_;
+    }
+
+    std::vector<Window> make_tiles(int width, int height, int tile) {
+        if (tile <= 0) return {{0, 0, width, height}};
+        const TileRange range(width, height, tile, tile);
+        return std::vector<Window>(range.begin(), range.end());
     }
 
 } // namespace gdiv::runner
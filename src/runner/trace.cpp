@@ -0,0 +1,177 @@
+#include "gdiv/runner/trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace gdiv::runner {
+
+namespace detail {
+std::atomic<bool> g_tracing{false};
+}
+
+namespace {
+
+    struct Event {
+        const char* name;
+        const char* arg_name;
+        int64_t arg;
+        int64_t t0, t1;   // steady_clock ticks
+        uint32_t tid;
+    };
+
+    // Written only by the thread that holds it, read by write_trace()
+    struct Ring {
+        std::vector<Event> events;
+        std::atomic<uint64_t> head{0};   // events recorded so far
+    };
+
+    struct Registry {
+        std::mutex m;
+        std::vector<std::unique_ptr<Ring>> rings;
+        std::vector<Ring*> free;         // rings of finished threads
+        std::vector<std::pair<uint32_t, std::string>> names;
+        size_t capacity = size_t(1) << 16;
+        int64_t origin = 0;              // ticks at start_trace()
+        uint32_t next_tid = 1;
+    };
+
+    Registry& registry() {
+        static Registry r;
+        return r;
+    }
+
+    // The calling thread's ring and track id; the ring goes back to the pool
+    // when the thread ends, its spans stay until the next start_trace()
+    struct ThreadTrack {
+        Ring* ring = nullptr;
+        uint32_t tid = 0;
+
+        ~ThreadTrack() {
+            if (!ring) return;
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lk(r.m);
+            r.free.push_back(ring);
+        }
+    };
+
+    thread_local ThreadTrack t_track;
+
+    // first span of a thread: the only step that locks
+    ThreadTrack& thread_track() {
+        ThreadTrack& t = t_track;
+        if (t.ring) return t;
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lk(r.m);
+        if (!r.free.empty()) {
+            t.ring = r.free.back();
+            r.free.pop_back();
+        } else {
+            r.rings.push_back(std::make_unique<Ring>());
+            r.rings.back()->events.resize(r.capacity);
+            t.ring = r.rings.back().get();
+        }
+        t.tid = r.next_tid++;
+        return t;
+    }
+
+    void write_string(std::FILE* f, const std::string& s) {
+        std::fputc('"', f);
+        for (const unsigned char c : s) {
+            if (c == '"' || c == '\\') std::fprintf(f, "\\%c", c);
+            else if (c < 0x20) std::fprintf(f, "\\u%04x", c);
+            else std::fputc(c, f);
+        }
+        std::fputc('"', f);
+    }
+
+} // namespace
+
+namespace detail {
+
+void trace_record(const char* name, const char* arg_name, int64_t arg,
+                  std::chrono::steady_clock::time_point t0,
+                  std::chrono::steady_clock::time_point t1) {
+    ThreadTrack& t = thread_track();
+    Ring& ring = *t.ring;
+    const uint64_t h = ring.head.load(std::memory_order_relaxed);
+    ring.events[h % ring.events.size()] = Event{name, arg_name, arg,
+                                                t0.time_since_epoch().count(),
+                                                t1.time_since_epoch().count(), t.tid};
+    ring.head.store(h + 1, std::memory_order_release);
+}
+
+} // namespace detail
+
+void start_trace(size_t events_per_thread) {
+    Registry& r = registry();
+    {
+        std::lock_guard<std::mutex> lk(r.m);
+        r.capacity = std::max<size_t>(events_per_thread, 16);
+        for (auto& ring : r.rings) {
+            ring->events.assign(r.capacity, Event{});
+            ring->head.store(0, std::memory_order_relaxed);
+        }
+        r.names.clear();
+        r.origin = std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+    detail::g_tracing.store(true, std::memory_order_release);
+}
+
+void stop_trace() {
+    detail::g_tracing.store(false, std::memory_order_release);
+}
+
+void set_trace_thread_name(const std::string& name) {
+    if (!tracing()) return;
+    const uint32_t tid = thread_track().tid;
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lk(r.m);
+    for (auto& n : r.names) {
+        if (n.first == tid) { n.second = name; return; }
+    }
+    r.names.emplace_back(tid, name);
+}
+
+bool write_trace(const std::string& path) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lk(r.m);
+
+    // newest events.size() spans of every ring, oldest first
+    std::vector<Event> events;
+    for (const auto& ring : r.rings) {
+        const uint64_t h = ring->head.load(std::memory_order_acquire);
+        const uint64_t cap = ring->events.size();
+        for (uint64_t i = (h > cap ? h - cap : 0); i < h; ++i) events.push_back(ring->events[i % cap]);
+    }
+    std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+        return a.t0 != b.t0 ? a.t0 < b.t0 : a.t1 > b.t1;   // enclosing spans first
+    });
+
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+    auto us = [&](int64_t ticks) {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::duration(ticks)).count();
+    };
+
+    std::fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    std::fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"gdiv\"}}");
+    for (const auto& n : r.names) {
+        std::fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", n.first);
+        write_string(f, n.second);
+        std::fprintf(f, "}}");
+    }
+    for (const Event& e : events) {
+        std::fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"gdiv\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                     e.name, e.tid, us(e.t0 - r.origin), us(e.t1 - e.t0));
+        if (e.arg_name) std::fprintf(f, ",\"args\":{\"%s\":%lld}", e.arg_name, static_cast<long long>(e.arg));
+        std::fprintf(f, "}");
+    }
+    std::fprintf(f, "\n]}\n");
+    const bool ok = std::ferror(f) == 0;
+    return std::fclose(f) == 0 && ok;
+}
+
+} // namespace gdiv::runner
@@ -0,0 +1,106 @@
+#include "gdiv/runner/windows.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace gdiv::runner {
+
+Window intersect(const Window& a, const Window& b) {
+    const int x0 = std::max(a.x, b.x), y0 = std::max(a.y, b.y);
+    const int x1 = std::min(a.x + a.w, b.x + b.w), y1 = std::min(a.y + a.h, b.y + b.h);
+    if (x1 <= x0 || y1 <= y0) return Window{};
+    return Window{x0, y0, x1 - x0, y1 - y0};
+}
+
+// [lo, hi) pixel span covering [a, b] in pixel units, clamped to [0, n]
+static void pixel_span(double a, double b, int n, int& lo, int& hi) {
+    const double eps = 1e-8;   // edges that fall on pixel boundaries up to rounding
+    if (a > b) std::swap(a, b);
+    const double l = std::floor(a + eps), h = std::ceil(b - eps);
+    lo = static_cast<int>(std::clamp(l, 0.0, static_cast<double>(n)));
+    hi = static_cast<int>(std::clamp(h, 0.0, static_cast<double>(n)));
+}
+
+std::vector<Window> geo_windows(GDALDataset* ds, const std::vector<GeoRect>& rects) {
+    if (!ds) throw std::runtime_error("geo_windows(): null dataset");
+    double gt[6];
+    if (ds->GetGeoTransform(gt) != CE_None)
+        throw std::runtime_error("geo_windows(): raster has no geotransform");
+    if (gt[2] != 0.0 || gt[4] != 0.0 || gt[1] == 0.0 || gt[5] == 0.0)
+        throw std::runtime_error("geo_windows(): rotated geotransform");
+
+    const int W = ds->GetRasterXSize(), H = ds->GetRasterYSize();
+    std::vector<Window> out;
+    out.reserve(rects.size());
+    for (const GeoRect& r : rects) {
+        int x0, x1, y0, y1;
+        pixel_span((r.xmin - gt[0]) / gt[1], (r.xmax - gt[0]) / gt[1], W, x0, x1);
+        pixel_span((r.ymin - gt[3]) / gt[5], (r.ymax - gt[3]) / gt[5], H, y0, y1);
+        if (x1 <= x0 || y1 <= y0) out.push_back(Window{});   // outside the raster
+        else out.push_back(Window{x0, y0, x1 - x0, y1 - y0});
+    }
+    return out;
+}
+
+WindowPlan plan_windows(GDALDataset* ds, const std::vector<Window>& windows, int tile, TileOrder order) {
+    if (!ds) throw std::runtime_error("plan_windows(): null dataset");
+    const TileRange grid = TileRange::for_dataset(ds, tile, order);
+    const int W = grid.width(), H = grid.height();
+    const int tw = grid.tile_w(), th = grid.tile_h();
+    const int cols = (W + tw - 1) / tw;
+
+    int bx = 0, by = 0;
+    if (ds->GetRasterCount() > 0) ds->GetRasterBand(1)->GetBlockSize(&bx, &by);
+    if (bx <= 0) bx = 1;
+    if (by <= 0) by = 1;
+
+    WindowPlan plan;
+    plan.clipped.reserve(windows.size());
+
+    // grid cell -> union of its window overlaps + the windows (ascending)
+    struct Cell {
+        int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+        std::vector<uint32_t> windows;
+    };
+    std::unordered_map<uint64_t, Cell> cells;
+    const Window all{0, 0, W, H};
+    for (size_t w = 0; w < windows.size(); ++w) {
+        const Window cw = (windows[w].w > 0 && windows[w].h > 0) ? intersect(windows[w], all) : Window{};
+        plan.clipped.push_back(cw);
+        if (cw.w <= 0) continue;
+        for (int ty = cw.y / th; ty <= (cw.y + cw.h - 1) / th; ++ty) {
+            for (int tx = cw.x / tw; tx <= (cw.x + cw.w - 1) / tw; ++tx) {
+                const Window ov = intersect(cw, Window{tx * tw, ty * th, tw, th});
+                Cell& c = cells[static_cast<uint64_t>(ty) * cols + tx];
+                if (c.windows.empty()) {
+                    c.x0 = ov.x; c.y0 = ov.y; c.x1 = ov.x + ov.w; c.y1 = ov.y + ov.h;
+                } else {
+                    c.x0 = std::min(c.x0, ov.x); c.y0 = std::min(c.y0, ov.y);
+                    c.x1 = std::max(c.x1, ov.x + ov.w); c.y1 = std::max(c.y1, ov.y + ov.h);
+                }
+                c.windows.push_back(static_cast<uint32_t>(w));
+            }
+        }
+    }
+    if (cells.empty()) return plan;
+
+    // touched cells in traversal order, each reading whole blocks around its windows
+    plan.tiles.reserve(cells.size());
+    for (const Window& t : grid) {
+        auto it = cells.find(static_cast<uint64_t>(t.y / th) * cols + t.x / tw);
+        if (it == cells.end()) continue;
+        const Cell& c = it->second;
+        const int x0 = c.x0 / bx * bx, y0 = c.y0 / by * by;
+        const int x1 = (c.x1 + bx - 1) / bx * bx, y1 = (c.y1 + by - 1) / by * by;
+        WindowPlan::Tile pt;
+        pt.read = intersect(Window{x0, y0, x1 - x0, y1 - y0}, t);
+        pt.windows = std::move(it->second.windows);
+        plan.tiles.push_back(std::move(pt));
+        cells.erase(it);
+        if (cells.empty()) break;
+    }
+    return plan;
+}
+
+} // namespace gdiv::runner
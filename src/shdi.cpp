@@ -1,24 +1,32 @@
 #include "gdiv_utils.h"
-#include <unordered_map>
+#include "gdiv/runner/stats.h"
 
-int shdi_compute(const char* path, const double* classes, int n_classes,
-                 const RasterOptions* opt, double* out_shdi, double* probs, uint64_t* out_valid) {
-    std::unordered_map<long long,int> lut;
-    for (int i=0;i<n_classes;++i){ lut[(long long)std::llround(classes[i])] = i; probs[i]=0.0; }
-    std::vector<uint64_t> counts(n_classes, 0);
-    uint64_t n=0;
+static int shdi_run(const std::function<int(const BlockFn&)>& source,
+                    const double* classes, int n_classes,
+                    double* out_shdi, double* probs, uint64_t* out_valid) {
+    gdiv::runner::ShdiReducer shdi(std::vector<double>(classes, classes + n_classes));
+    for (int i=0;i<n_classes;++i) probs[i]=0.0;
 
-    int rc = for_each_pixel_double(path, opt, [&](double v){
-        auto it = lut.find((long long)std::llround(v));
-        if (it!=lut.end()) { counts[it->second]++; ++n; }
-    }, /*require_non_empty=*/true);
+    int rc = source([&](const gdiv::runner::Block& blk){
+        shdi.accumulate(blk);
+    });
     if (rc) return rc;
+    gdiv::runner::stats_add(gdiv::runner::Counter::Valid, shdi.valid);
+    if (shdi.valid == 0) return 3;
+
+    for (int i=0;i<n_classes;++i) probs[i] = (double)shdi.counts[i] / (double)shdi.total;
+    shdi.finalize(out_shdi);
+    *out_valid=shdi.total; return 0;
+}
+
+int shdi_compute(const char* path, const double* classes, int n_classes,
+                 const RasterOptions* opt, double* out_shdi, double* probs, uint64_t* out_valid) {
+    return shdi_run([&](const BlockFn& fn){ return for_each_block_double(path, opt, fn); },
+                    classes, n_classes, out_shdi, probs, out_valid);
+}
 
-    long double H=0.0L;
-    for (int i=0;i<n_classes;++i){
-        double p = (double)counts[i] / (double)n;
-        probs[i]=p;
-        if (p>0) H -= p * std::log(p);
-    }
-    *out_shdi=(double)H; *out_valid=n; return 0;
-}
\ No newline at end of file
+int shdi_compute_buffer(const RasterBuffer* buf, const double* classes, int n_classes,
+                        const RasterOptions* opt, double* out_shdi, double* probs, uint64_t* out_valid) {
+    return shdi_run([&](const BlockFn& fn){ return for_each_block_buffer(buf, opt, fn); },
+                    classes, n_classes, out_shdi, probs, out_valid);
+}
@@ -1,14 +1,366 @@
-#include "E:/gdiv_calculator/include/gdiv_toolbox.h"
+#include "gdiv_toolbox.h"
+#include "gdiv/runner/runner.h"
+#include "landscape.h"
+#include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
-int main() {
-    RasterOptions opt;
+// Windows of files in every raw layout, read from the memory map and through
+// GDAL: both must give the same numbers
+static int check_mapped_reads() {
+    struct Layout {
+        const char* file;
+        const char* driver;
+        GDALDataType type;
+        int bands;
+        std::vector<const char*> options;
+    };
+    const std::vector<Layout> layouts = {
+        {"tiled.tif",   "GTiff", GDT_Int16,   1, {"TILED=YES", "BLOCKXSIZE=64", "BLOCKYSIZE=48"}},   // partial edge blocks
+        {"striped.tif", "GTiff", GDT_Float32, 1, {"TILED=NO", "BLOCKYSIZE=7"}},
+        {"pixel.tif",   "GTiff", GDT_UInt16,  3, {"TILED=YES", "INTERLEAVE=PIXEL"}},
+        {"band.tif",    "GTiff", GDT_Byte,    3, {"INTERLEAVE=BAND"}},
+        {"bsq.img",     "ENVI",  GDT_Int32,   2, {"INTERLEAVE=BSQ"}},
+        {"bip.img",     "ENVI",  GDT_Float64, 3, {"INTERLEAVE=BIP"}},
+    };
+    const int W = 300, H = 203;
+    const int wins[] = {
+        0, 0, W, H,          // everything
+        250, 190, 50, 13,    // last partial block
+        63, 47, 3, 3,        // across a block corner
+        5, 100, 290, 1,      // one row
+        W - 1, 0, 1, H,      // last column
+    };
+    const int n_wins = 5;
+    const MetricSpec spec = {GDIV_METRIC_MSR, nullptr, 0};
+    const int cols = gdiv_batch_columns(&spec, 1);
+    RasterOptions opt{};
+    opt.win_size = 32;
+
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "gdiv_test_mapped";
+    std::filesystem::create_directories(dir);
+    int failures = 0;
+    gdiv_set_dataset_cache(8);   // maps live in cached datasets
+    for (const Layout& l : layouts) {
+        const std::string path = (dir / l.file).string();
+        GDALDriver* drv = GetGDALDriverManager()->GetDriverByName(l.driver);
+        if (!drv) continue;   // driver not built in
+        std::vector<const char*> co = l.options;
+        co.push_back(nullptr);
+        GDALDataset* ds = drv->Create(path.c_str(), W, H, l.bands, l.type, const_cast<char**>(co.data()));
+        if (!ds) {
+            std::cout << "Cannot create " << path << std::endl;
+            ++failures;
+            continue;
+        }
+        // a different value at every position (and band) to catch misplaced offsets
+        std::vector<double> px(static_cast<size_t>(W) * H);
+        for (int b = 1; b <= l.bands; ++b) {
+            for (int y = 0; y < H; ++y)
+                for (int x = 0; x < W; ++x)
+                    px[static_cast<size_t>(y) * W + x] = (y * 31 + x * 7) % 241 + b;
+            if (ds->GetRasterBand(b)->RasterIO(GF_Write, 0, 0, W, H, px.data(), W, H, GDT_Float64, 0, 0) != CE_None)
+                ++failures;
+        }
+        GDALClose(ds);
+
+        std::vector<double> res[2];
+        std::vector<int> status[2];
+        GdivStats stats[2] = {};
+        for (int mapped = 0; mapped < 2; ++mapped) {
+            gdiv_set_mapped_reads(mapped);
+            gdiv_close_datasets();
+            res[mapped].assign(static_cast<size_t>(n_wins) * cols, 0.0);
+            status[mapped].assign(n_wins, -1);
+            gdiv_set_stats(&stats[mapped]);
+            const int rc = gdiv_calculate_windows(path.c_str(), wins, n_wins, &spec, 1, &opt,
+                                                  res[mapped].data(), status[mapped].data());
+            gdiv_set_stats(nullptr);
+            if (rc != 0) ++failures;
+        }
+        gdiv_close_datasets();
+        drv->Delete(path.c_str());
+
+        bool same = status[0] == status[1];
+        for (size_t i = 0; i < res[0].size(); ++i)
+            same = same && (res[0][i] == res[1][i] || (std::isnan(res[0][i]) && std::isnan(res[1][i])));
+        for (int s : status[1]) same = same && s == 0;
+        // nothing went through RasterIO, so the map was used
+        const bool used_map = stats[1].read_seconds == 0 && stats[1].convert_seconds > 0;
+        if (!same || !used_map) {
+            std::cout << "Mapped reads differ for " << l.file << (used_map ? "" : " (map not used)") << std::endl;
+            ++failures;
+        }
+    }
+    gdiv_set_mapped_reads(0);
+    gdiv_set_dataset_cache(0);
+    std::filesystem::remove_all(dir);
+    return failures;
+}
+
+static bool same_values(const std::vector<double>& a, const std::vector<double>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (!(a[i] == b[i] || (std::isnan(a[i]) && std::isnan(b[i])))) return false;
+    return true;
+}
+
+static std::string read_text(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
+    std::stringstream ss;
+    ss << f.rdbuf();
+    return ss.str();
+}
+
+static void write_text(const std::string& path, const std::string& text) {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f << text;
+}
+
+// Journal lines after the header
+static std::vector<std::string> journal_records(const std::string& text) {
+    std::vector<std::string> lines;
+    std::stringstream ss(text);
+    std::string line;
+    std::getline(ss, line);
+    while (std::getline(ss, line)) lines.push_back(line);
+    return lines;
+}
+
+// A resumed run must read only the rasters the journal lacks: every other
+// raster is deleted before it, so reading one would fail the run
+static int check_journal() {
+    namespace runner = gdiv::runner;
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "gdiv_test_journal";
+    std::filesystem::create_directories(dir);
+    const std::string journal = (dir / "run.journal").string();
+    std::filesystem::remove(journal);
+
+    std::vector<std::string> rasters;
+    for (int k = 0; k < 5; ++k) rasters.push_back((dir / ("r" + std::to_string(k) + ".tif")).string());
+    auto generate = [&]() {
+        for (size_t k = 0; k < rasters.size(); ++k) {
+            gdiv::landscape::LandscapeSpec spec;
+            spec.pattern = gdiv::landscape::Pattern::Clustered;
+            spec.width = 200;
+            spec.height = 150;
+            spec.nodata_fraction = 0.05;
+            spec.seed = 10 + k;
+            if (!gdiv::landscape::write_geotiff(rasters[k], spec)) return false;
+        }
+        return true;
+    };
+    // resume with only `keep` on disk
+    auto resume = [&](const std::string& keep, const runner::RunOptions& opt) {
+        for (const std::string& r : rasters)
+            if (r != keep) std::filesystem::remove(r);
+        return runner::process_many(rasters, opt, runner::MsrReducer{});
+    };
+    auto last_path = [](const std::string& record) { return record.substr(record.rfind('\t') + 1); };
+
+    int failures = 0;
+    auto expect = [&](bool ok, const char* what) {
+        if (!ok) {
+            std::cout << "Journal: " << what << std::endl;
+            ++failures;
+        }
+    };
+    if (!generate()) {
+        std::cout << "Cannot generate journal rasters" << std::endl;
+        return 1;
+    }
+
+    runner::RunOptions opt;
+    opt.tile = 64;
+    opt.cache = false;
+    const runner::Result ref = runner::process_many(rasters, opt, runner::MsrReducer{});
+    opt.journal = journal;
+    expect(same_values(runner::process_many(rasters, opt, runner::MsrReducer{}).values, ref.values), "journaled run differs");
+    const std::string full = read_text(journal);
+    expect(journal_records(full).size() == rasters.size(), "one record per raster");
+
+    try {
+        // last line cut off (killed while writing): only its raster is read again
+        std::string cut = full.substr(0, full.size() - 5);
+        const std::string torn = last_path(journal_records(full).back());
+        write_text(journal, cut);
+        expect(same_values(resume(torn, opt).values, ref.values), "resume after a cut-off line");
+
+        // the completed run compacts to input order
+        const std::vector<std::string> records = journal_records(read_text(journal));
+        bool ordered = records.size() == rasters.size();
+        for (size_t k = 0; ordered && k < records.size(); ++k) ordered = last_path(records[k]) == rasters[k];
+        expect(ordered, "compaction to input order");
+
+        // a value changed on disk fails the checksum: that raster is read again
+        expect(generate(), "regenerate");
+        std::string text = read_text(journal);
+        const size_t line = text.rfind('\n', text.size() - 2) + 1;
+        const size_t value = text.find('\t', text.find('\t', line) + 1) + 1;
+        text[value] = text[value] == '1' ? '2' : '1';
+        write_text(journal, text);
+        expect(same_values(resume(rasters.back(), opt).values, ref.values), "resume after a bad checksum");
+
+        // a journal of another run is refused
+        bool threw = false;
+        try {
+            runner::process_many(rasters, opt, runner::ShdiReducer{});
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        expect(threw, "tag mismatch not refused");
+    } catch (const std::exception& e) {
+        std::cout << "Journal: " << e.what() << std::endl;
+        ++failures;
+    }
+    std::filesystem::remove_all(dir);
+    return failures;
+}
+
+// Pair metrics on layers laid out from a known contingency table, against
+// values worked out by hand from that table
+static int check_joint() {
+    namespace runner = gdiv::runner;
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "gdiv_test_joint";
+    std::filesystem::create_directories(dir);
+    const std::string path_a = (dir / "a.tif").string(), path_b = (dir / "b.tif").string();
+    GDALDriver* drv = GetGDALDriverManager()->GetDriverByName("GTiff");
+
+    // table[i][j] pixels of class i + 1 in A and j + 1 in B, in a 10 x 10 raster
+    auto write_pair = [&](const std::vector<std::vector<int>>& table) {
+        std::vector<double> a, b;
+        for (size_t i = 0; i < table.size(); ++i)
+            for (size_t j = 0; j < table[i].size(); ++j) {
+                a.insert(a.end(), table[i][j], static_cast<double>(i + 1));
+                b.insert(b.end(), table[i][j], static_cast<double>(j + 1));
+            }
+        bool ok = a.size() == 100;
+        for (const auto& [path, px] : {std::make_pair(path_a, &a), std::make_pair(path_b, &b)}) {
+            GDALDataset* ds = ok ? drv->Create(path.c_str(), 10, 10, 1, GDT_Byte, nullptr) : nullptr;
+            ok = ds && ds->GetRasterBand(1)->RasterIO(GF_Write, 0, 0, 10, 10, px->data(), 10, 10,
+                                                      GDT_Float64, 0, 0) == CE_None;
+            if (ds) GDALClose(ds);
+        }
+        return ok;
+    };
+
+    int failures = 0;
+    auto expect = [&](const char* what, const double* out, const double (&want)[5]) {
+        const char* names[5] = {"H(A)", "H(B)", "H(A,B)", "MI", "V"};
+        for (int m = 0; m < 5; ++m) {
+            if (std::fabs(out[m] - want[m]) > 1e-12) {
+                std::cout << "Joint " << what << ": " << names[m] << " " << out[m] << ", expected " << want[m] << std::endl;
+                ++failures;
+            }
+        }
+    };
+    auto h = [](std::initializer_list<double> p) {
+        double s = 0;
+        for (double q : p) s -= q * std::log(q);
+        return s;
+    };
+
+    RasterOptions opt{};
+    double out[5];
+    uint64_t valid = 0;
+
+    // rows 40/60, columns 50/50: chi^2 = 100 * (0.45 + 0.05 + 0.4/3 + 1.6/3 - 1), V = sqrt(1/6)
+    if (!write_pair({{30, 10}, {20, 40}})) {
+        std::cout << "Cannot generate joint rasters" << std::endl;
+        return 1;
+    }
+    if (gdiv_calculate_joint(path_a.c_str(), path_b.c_str(), nullptr, 0, nullptr, 0, &opt, out, nullptr, &valid) != 0
+        || valid != 100) {
+        ++failures;
+    } else {
+        const double ha = h({0.4, 0.6}), hb = h({0.5, 0.5}), hab = h({0.3, 0.1, 0.2, 0.4});
+        expect("dependent", out, {ha, hb, hab, ha + hb - hab, std::sqrt(1.0 / 6)});
+    }
+
+    // independent: every cell is its row share times its column share
+    const double classes[3] = {1, 2, 3};
+    uint64_t table[9] = {};
+    if (!write_pair({{12, 28}, {18, 42}})
+        || gdiv_calculate_joint(path_a.c_str(), path_b.c_str(), classes, 2, classes, 2, &opt, out, table, &valid) != 0) {
+        ++failures;
+    } else {
+        const double ha = h({0.4, 0.6}), hb = h({0.3, 0.7});
+        expect("independent", out, {ha, hb, ha + hb, 0, 0});
+        if (table[0] != 12 || table[1] != 28 || table[2] != 18 || table[3] != 42) {
+            std::cout << "Joint independent: wrong table" << std::endl;
+            ++failures;
+        }
+    }
+
+    // identical layers: H(A,B) = H(A) = MI, V = 1
+    if (!write_pair({{20, 0, 0}, {0, 30, 0}, {0, 0, 50}})
+        || gdiv_calculate_joint(path_a.c_str(), path_b.c_str(), classes, 3, classes, 3, &opt, out, nullptr, &valid) != 0) {
+        ++failures;
+    } else {
+        const double ha = h({0.2, 0.3, 0.5});
+        expect("identical", out, {ha, ha, ha, ha, 1});
+    }
+
+    // a fixed table needs the classes of both layers
+    bool threw = false;
+    try {
+        runner::JointReducer({1, 2}, {});
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    if (!threw) {
+        std::cout << "Joint: classes of one layer only not refused" << std::endl;
+        ++failures;
+    }
+
+    gdiv_close_datasets();
+    std::filesystem::remove_all(dir);
+    return failures;
+}
+
+int main(int argc, char** argv) {
+    // A raster given on the command line, else a generated landscape kept in memory
+    const std::string path = (argc > 1) ? argv[1] : "/vsimem/test_basic.tif";
+    gdiv::landscape::LandscapeSpec spec;
+    spec.pattern = gdiv::landscape::Pattern::Fractal;
+    spec.nodata_fraction = 0.1;
+    if (argc <= 1) GDALAllRegister();
+    if (argc <= 1 && !gdiv::landscape::write_geotiff(path, spec)) {
+        std::cout << "Cannot generate " << path << std::endl;
+        return 1;
+    }
+
+    RasterOptions opt{};
     double mean, stdv, vmin, vmax;
     uint64_t valid;
-    int ret = gdiv_calculate_msr("E:/gdiv_calculator/example_raster/T5FPCF.tiff", &opt, &mean, &stdv, &vmin, &vmax, &valid);
+    int ret = gdiv_calculate_msr(path.c_str(), &opt, &mean, &stdv, &vmin, &vmax, &valid);
     if (ret == 0)
         std::cout << "Mean: " << mean << ", Std: " << stdv << ", N: " << valid << std::endl;
     else
         std::cout << "Error code: " << ret << std::endl;
-    return 0;
-}
\ No newline at end of file
+    if (ret != 0 || argc > 1) return ret;
+
+    // The generated raster is known: every non-nodata pixel counts, classes are 1..classes
+    std::vector<double> px(static_cast<size_t>(spec.width) * spec.height);
+    gdiv::landscape::Landscape(spec).fill(0, 0, spec.width, spec.height, px.data());
+    uint64_t nodata = 0;
+    for (double v : px) nodata += (v == 0) ? 1 : 0;
+    if (valid != px.size() - nodata) {
+        std::cout << "Valid pixels " << valid << ", expected " << px.size() - nodata << std::endl;
+        ret = 1;
+    }
+    if (!(vmin >= 1 && vmax <= spec.classes && mean >= vmin && mean <= vmax)) {
+        std::cout << "Values outside 1.." << spec.classes << ": min " << vmin << ", max " << vmax << std::endl;
+        ret = 1;
+    }
+
+    if (check_mapped_reads() != 0) ret = 1;
+    if (check_journal() != 0) ret = 1;
+    if (check_joint() != 0) ret = 1;
+    return ret;
+}
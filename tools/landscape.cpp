@@ -0,0 +1,285 @@
+#include "landscape.h"
+#include <algorithm>
+#include <cmath>
+#include <cpl_string.h>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+namespace gdiv::landscape {
+
+// Counter-based randomness: every draw is a hash of (seed, stream, x, y)
+static inline uint64_t mix(uint64_t z) {
+    z += 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t draw(uint64_t seed, uint64_t stream, int64_t x, int64_t y) {
+    return mix(mix(mix(seed ^ (stream * 0xD1B54A32D192ED03ull)) ^ static_cast<uint64_t>(x)) ^ static_cast<uint64_t>(y));
+}
+
+// [0, 1)
+static inline double unit(uint64_t h) {
+    return static_cast<double>(h >> 11) * 0x1.0p-53;
+}
+
+// Standard normal (Box-Muller)
+static inline double gauss(uint64_t seed, int64_t x, int64_t y) {
+    const double u1 = unit(draw(seed, 3, x, y)) + 0x1.0p-54;
+    const double u2 = unit(draw(seed, 4, x, y));
+    return std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+}
+
+enum : uint64_t { STREAM_CLASS = 1, STREAM_NODATA = 2, STREAM_SEED_X = 5, STREAM_SEED_Y = 6, STREAM_SEED_CLASS = 7 };
+
+// Sampled lattice spacing for the fractal class cuts: at most ~1024 x 1024 samples
+static const int FRACTAL_SAMPLE_SIDE = 1024;
+
+bool parse_pattern(const std::string& name, Pattern& out) {
+    if (name == "random") { out = Pattern::Random; return true; }
+    if (name == "fractal") { out = Pattern::Fractal; return true; }
+    if (name == "clustered") { out = Pattern::Clustered; return true; }
+    return false;
+}
+
+const char* pattern_name(Pattern p) {
+    switch (p) {
+        case Pattern::Fractal: return "fractal";
+        case Pattern::Clustered: return "clustered";
+        default: return "random";
+    }
+}
+
+Landscape::Landscape(const LandscapeSpec& spec) : spec_(spec) {
+    if (spec.width <= 0 || spec.height <= 0) throw std::invalid_argument("landscape: empty size");
+    if (spec.classes <= 0) throw std::invalid_argument("landscape: classes must be > 0");
+    if (!spec.proportions.empty() && static_cast<int>(spec.proportions.size()) != spec.classes)
+        throw std::invalid_argument("landscape: one proportion per class");
+    if (!(spec.nodata_fraction >= 0.0 && spec.nodata_fraction < 1.0))
+        throw std::invalid_argument("landscape: nodata_fraction must be in [0, 1)");
+    if (!(spec.roughness >= 0.0 && spec.roughness <= 1.0))
+        throw std::invalid_argument("landscape: roughness must be in [0, 1]");
+    if (spec.patch <= 0) throw std::invalid_argument("landscape: patch must be > 0");
+
+    double sum = 0;
+    for (int c = 0; c < spec.classes; ++c) {
+        const double p = spec.proportions.empty() ? 1.0 : spec.proportions[c];
+        if (!(p >= 0.0)) throw std::invalid_argument("landscape: negative proportion");
+        sum += p;
+        cum_.push_back(sum);
+    }
+    if (!(sum > 0.0)) throw std::invalid_argument("landscape: proportions sum to 0");
+    for (double& c : cum_) c /= sum;
+
+    if (spec.pattern != Pattern::Fractal) return;
+    while (side_ < std::max(spec.width, spec.height)) side_ *= 2;
+
+    // cut the surface where the sampled values reach each cumulative proportion
+    const int stop = std::max(1, side_ / FRACTAL_SAMPLE_SIDE);
+    std::vector<double> grid;
+    int gx, gy, nx, ny;
+    fractal(0, 0, spec.width, spec.height, stop, grid, gx, gy, nx, ny);
+    std::vector<double> samples;
+    for (int j = 0; j < ny; ++j) {
+        if (gy + j * stop >= spec.height) break;
+        for (int i = 0; i < nx && gx + i * stop < spec.width; ++i) samples.push_back(grid[static_cast<size_t>(j) * nx + i]);
+    }
+    std::sort(samples.begin(), samples.end());
+    for (int c = 0; c + 1 < spec.classes; ++c) {
+        const size_t k = std::min(samples.size() - 1, static_cast<size_t>(cum_[c] * samples.size()));
+        cuts_.push_back(samples[k]);
+    }
+}
+
+int Landscape::class_of(double u) const {
+    return static_cast<int>(std::upper_bound(cum_.begin(), cum_.end() - 1, u) - cum_.begin()) + 1;
+}
+
+// Midpoint displacement on the side_ lattice, refined only where the window
+// needs it: every node is the mean of its parents plus noise scaled by
+// (spacing / side)^roughness, so a node's value does not depend on the window.
+// grid: nodes at multiples of `stop` from (gx, gy), nx x ny, covering the window.
+void Landscape::fractal(int x, int y, int w, int h, int stop, std::vector<double>& grid,
+                        int& gx, int& gy, int& nx, int& ny) const {
+    const uint64_t seed = spec_.seed;
+    const int S = side_;
+    gx = gy = 0;
+    nx = ny = 2;
+    grid = {gauss(seed, 0, 0), gauss(seed, S, 0), gauss(seed, 0, S), gauss(seed, S, S)};
+
+    std::vector<double> fine;
+    for (int s = S; s > stop; s /= 2) {
+        const int hs = s / 2;
+        const double amp = std::pow(static_cast<double>(hs) / S, spec_.roughness);
+        // part of the refined lattice the window still needs
+        const int x0 = x / hs * hs, x1 = (x + w - 1) / hs * hs + hs;
+        const int y0 = y / hs * hs, y1 = (y + h - 1) / hs * hs + hs;
+        const int mx = (x1 - x0) / hs + 1, my = (y1 - y0) / hs + 1;
+        fine.resize(static_cast<size_t>(mx) * my);
+        for (int j = 0; j < my; ++j) {
+            const int Y = y0 + j * hs;
+            const int pj = (Y - gy) / s, oj = ((Y - gy) / hs) & 1;
+            for (int i = 0; i < mx; ++i) {
+                const int X = x0 + i * hs;
+                const int pi = (X - gx) / s, oi = ((X - gx) / hs) & 1;
+                const double* g = grid.data() + static_cast<size_t>(pj) * nx + pi;
+                double v;
+                if (!oi && !oj) v = g[0];
+                else if (oi && !oj) v = 0.5 * (g[0] + g[1]) + amp * gauss(seed, X, Y);
+                else if (!oi) v = 0.5 * (g[0] + g[nx]) + amp * gauss(seed, X, Y);
+                else v = 0.25 * (g[0] + g[1] + g[nx] + g[nx + 1]) + amp * gauss(seed, X, Y);
+                fine[static_cast<size_t>(j) * mx + i] = v;
+            }
+        }
+        grid.swap(fine);
+        gx = x0; gy = y0; nx = mx; ny = my;
+    }
+}
+
+void Landscape::fill(int x, int y, int w, int h, double* out) const {
+    if (w <= 0 || h <= 0) return;
+    const uint64_t seed = spec_.seed;
+
+    switch (spec_.pattern) {
+        case Pattern::Random:
+            for (int j = 0; j < h; ++j)
+                for (int i = 0; i < w; ++i)
+                    out[static_cast<size_t>(j) * w + i] = class_of(unit(draw(seed, STREAM_CLASS, x + i, y + j)));
+            break;
+
+        case Pattern::Fractal: {
+            std::vector<double> grid;
+            int gx, gy, nx, ny;
+            fractal(x, y, w, h, 1, grid, gx, gy, nx, ny);
+            for (int j = 0; j < h; ++j) {
+                const double* row = grid.data() + static_cast<size_t>(y + j - gy) * nx + (x - gx);
+                for (int i = 0; i < w; ++i)
+                    out[static_cast<size_t>(j) * w + i] =
+                        static_cast<double>(std::upper_bound(cuts_.begin(), cuts_.end(), row[i]) - cuts_.begin() + 1);
+            }
+            break;
+        }
+
+        case Pattern::Clustered: {
+            // one seed per cell; the nearest seed is always within two cells
+            const int c = spec_.patch;
+            const int cx0 = x / c - 2, cy0 = y / c - 2;
+            const int ncx = (x + w - 1) / c + 3 - cx0, ncy = (y + h - 1) / c + 3 - cy0;
+            struct Seed { double px, py; int cls; };
+            std::vector<Seed> seeds(static_cast<size_t>(ncx) * ncy);
+            for (int j = 0; j < ncy; ++j) {
+                for (int i = 0; i < ncx; ++i) {
+                    const int cx = cx0 + i, cy = cy0 + j;
+                    seeds[static_cast<size_t>(j) * ncx + i] = {
+                        (cx + unit(draw(seed, STREAM_SEED_X, cx, cy))) * c,
+                        (cy + unit(draw(seed, STREAM_SEED_Y, cx, cy))) * c,
+                        class_of(unit(draw(seed, STREAM_SEED_CLASS, cx, cy)))};
+                }
+            }
+            for (int j = 0; j < h; ++j) {
+                const double py = y + j + 0.5;
+                const int cj = (y + j) / c - cy0;
+                for (int i = 0; i < w; ++i) {
+                    const double px = x + i + 0.5;
+                    const int ci = (x + i) / c - cx0;
+                    double best = std::numeric_limits<double>::infinity();
+                    int cls = 1;
+                    for (int dj = -2; dj <= 2; ++dj) {
+                        const Seed* row = seeds.data() + static_cast<size_t>(cj + dj) * ncx + ci;
+                        for (int di = -2; di <= 2; ++di) {
+                            const Seed& sd = row[di];
+                            const double d = (sd.px - px) * (sd.px - px) + (sd.py - py) * (sd.py - py);
+                            if (d < best) { best = d; cls = sd.cls; }
+                        }
+                    }
+                    out[static_cast<size_t>(j) * w + i] = cls;
+                }
+            }
+            break;
+        }
+    }
+
+    if (spec_.nodata_fraction > 0.0) {
+        for (int j = 0; j < h; ++j)
+            for (int i = 0; i < w; ++i)
+                if (unit(draw(seed, STREAM_NODATA, x + i, y + j)) < spec_.nodata_fraction)
+                    out[static_cast<size_t>(j) * w + i] = 0.0;
+    }
+}
+
+static void georeference(GDALDataset* ds, int height) {
+    double gt[6] = {0, 1, 0, static_cast<double>(height), 0, -1};
+    ds->SetGeoTransform(gt);
+    ds->GetRasterBand(1)->SetNoDataValue(0);
+}
+
+bool write_geotiff(const std::string& path, const LandscapeSpec& spec, const GeoTiffOptions& opt) {
+    const Landscape land(spec);
+    GDALDriver* drv = GetGDALDriverManager()->GetDriverByName("GTiff");
+    if (!drv) return false;
+
+    const int tile = std::max(16, (opt.tile + 15) / 16 * 16);   // GTiff tiles are multiples of 16
+    char** co = nullptr;
+    co = CSLSetNameValue(co, "TILED", "YES");
+    co = CSLSetNameValue(co, "BLOCKXSIZE", std::to_string(tile).c_str());
+    co = CSLSetNameValue(co, "BLOCKYSIZE", std::to_string(tile).c_str());
+    co = CSLSetNameValue(co, "BIGTIFF", "IF_SAFER");
+    if (!opt.compress.empty()) co = CSLSetNameValue(co, "COMPRESS", opt.compress.c_str());
+    GDALDataset* ds = drv->Create(path.c_str(), spec.width, spec.height, 1, opt.type, co);
+    CSLDestroy(co);
+    if (!ds) return false;
+    georeference(ds, spec.height);
+    GDALRasterBand* band = ds->GetRasterBand(1);
+
+    // generate up to `workers` tiles at a time, write them in order
+    const int workers = opt.threads > 0 ? opt.threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    const int cols = (spec.width + tile - 1) / tile;
+    std::vector<std::vector<double>> bufs(workers, std::vector<double>(static_cast<size_t>(tile) * tile));
+    bool ok = true;
+    for (int y = 0; y < spec.height && ok; y += tile) {
+        const int h = std::min(tile, spec.height - y);
+        for (int t0 = 0; t0 < cols && ok; t0 += workers) {
+            const int n = std::min(workers, cols - t0);
+            auto gen = [&](int k) {
+                const int x = (t0 + k) * tile;
+                land.fill(x, y, std::min(tile, spec.width - x), h, bufs[k].data());
+            };
+            std::vector<std::thread> pool;
+            for (int k = 1; k < n; ++k) pool.emplace_back(gen, k);
+            gen(0);
+            for (auto& th : pool) th.join();
+            for (int k = 0; k < n && ok; ++k) {
+                const int x = (t0 + k) * tile, w = std::min(tile, spec.width - x);
+                ok = band->RasterIO(GF_Write, x, y, w, h, bufs[k].data(), w, h, GDT_Float64, 0, 0) == CE_None;
+            }
+        }
+    }
+    GDALClose(ds);
+    return ok;
+}
+
+GDALDataset* create_mem(const LandscapeSpec& spec, GDALDataType type) {
+    const Landscape land(spec);
+    GDALDriver* drv = GetGDALDriverManager()->GetDriverByName("MEM");
+    if (!drv) return nullptr;
+    GDALDataset* ds = drv->Create("", spec.width, spec.height, 1, type, nullptr);
+    if (!ds) return nullptr;
+    georeference(ds, spec.height);
+
+    const int rows = 64;
+    std::vector<double> buf(static_cast<size_t>(spec.width) * rows);
+    for (int y = 0; y < spec.height; y += rows) {
+        const int h = std::min(rows, spec.height - y);
+        land.fill(0, y, spec.width, h, buf.data());
+        if (ds->GetRasterBand(1)->RasterIO(GF_Write, 0, y, spec.width, h, buf.data(), spec.width, h,
+                                           GDT_Float64, 0, 0) != CE_None) {
+            GDALClose(ds);
+            return nullptr;
+        }
+    }
+    return ds;
+}
+
+} // namespace gdiv::landscape
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <gdal_priv.h>
+
+// Neutral-landscape rasters for benchmarks and tests: categorical patterns with
+// controlled class count, class proportions and patch structure, at any size.
+//
+// Every pixel is a pure function of (spec, x, y): windows can be generated in
+// any order, on any number of threads, and always give the same raster for
+// the same spec. Random and Clustered pixels do not depend on width / height
+// (a smaller raster is a crop of a larger one with the same seed); Fractal
+// lattice, amplitudes and class cuts follow the raster size, so it is only
+// reproduced at the same size. Class codes are 1..classes; 0 is nodata.
+namespace gdiv::landscape {
+
+    enum class Pattern {
+        Random,      // independent pixels
+        Fractal,     // midpoint displacement surface cut at the class proportions
+        Clustered    // Voronoi patches around one random seed per patch x patch cell
+    };
+
+    struct LandscapeSpec {
+        Pattern pattern = Pattern::Random;
+        int width = 1024, height = 1024;
+        int classes = 5;
+        std::vector<double> proportions;   // per class (normalized), empty = equal
+        double nodata_fraction = 0.0;      // share of pixels set to 0
+        double roughness = 0.5;            // Fractal: Hurst exponent, 0 rough .. 1 smooth
+        int patch = 32;                    // Clustered: mean patch width in pixels
+        uint64_t seed = 1;
+    };
+
+    /** Parses "random", "fractal" or "clustered"; false for anything else. */
+    bool parse_pattern(const std::string& name, Pattern& out);
+    const char* pattern_name(Pattern p);
+
+    class Landscape {
+    public:
+        /** Throws std::invalid_argument for an unusable spec. */
+        explicit Landscape(const LandscapeSpec& spec);
+
+        /** Classes of the window at (x, y), w x h, row-major into out. */
+        void fill(int x, int y, int w, int h, double* out) const;
+
+        const LandscapeSpec& spec() const { return spec_; }
+
+    private:
+        int class_of(double u) const;   // u in [0,1) by cumulative proportion
+        void fractal(int x, int y, int w, int h, int stop, std::vector<double>& grid,
+                     int& gx, int& gy, int& nx, int& ny) const;
+
+        LandscapeSpec spec_;
+        std::vector<double> cum_;    // cumulative class proportions
+        std::vector<double> cuts_;   // Fractal: surface value where each class ends
+        int side_ = 1;               // Fractal: power-of-two lattice side
+    };
+
+    struct GeoTiffOptions {
+        GDALDataType type = GDT_Byte;
+        int tile = 512;             // block size
+        std::string compress;       // COMPRESS creation option, empty = none
+        int threads = 0;            // generating threads, 0 = one per hardware thread
+    };
+
+    /** Writes a tiled GeoTIFF (north-up, 1 unit pixels, nodata 0), one block
+     *  row at a time. A /vsimem/ path keeps it in memory and still opens by
+     *  path in every entry point. False when GDAL fails.
+     */
+    bool write_geotiff(const std::string& path, const LandscapeSpec& spec,
+                       const GeoTiffOptions& opt = GeoTiffOptions());
+
+    /** Same raster as a GDAL MEM dataset (close with GDALClose), or nullptr. */
+    GDALDataset* create_mem(const LandscapeSpec& spec, GDALDataType type = GDT_Byte);
+
+} // namespace gdiv::landscape